@@ -7,7 +7,10 @@ global _start
 extern kmain
 
 section .bss
-align 16
+align 4096
+global stack_guard
+stack_guard:
+    resb 4096   ; left unmapped by paging_init()
 stack_bottom:
     resb 16384  ; 16 KB stack
 stack_top:
@@ -1,5 +1,7 @@
 #include <core/arch/cpuid.h>
 
+static uint32_t cpu_feature_bits = 0;
+
 void cpuid(uint32_t leaf, uint32_t subleaf, cpuid_result_t* result) {
     asm volatile(
         "mov %4, %%ecx\n\t"
@@ -13,3 +15,40 @@ void cpuid(uint32_t leaf, uint32_t subleaf, cpuid_result_t* result) {
         : "%ebx", "%ecx", "%edx"
     );
 }
+
+static void cpu_feature_set(cpu_feature_t feature, bool present) {
+    if (present) {
+        cpu_feature_bits |= (1u << feature);
+    }
+}
+
+void cpu_features_init(void) {
+    cpuid_result_t result;
+
+    cpu_feature_bits = 0;
+
+    cpuid(0, 0, &result);
+    uint32_t max_leaf = result.eax;
+
+    cpuid(1, 0, &result);
+    cpu_feature_set(CPU_FEATURE_TSC, result.edx & (1 << 4));
+    cpu_feature_set(CPU_FEATURE_PGE, result.edx & (1 << 13));
+    cpu_feature_set(CPU_FEATURE_PAT, result.edx & (1 << 16));
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, &result);
+        cpu_feature_set(CPU_FEATURE_ERMS, result.ebx & (1 << 9));
+        cpu_feature_set(CPU_FEATURE_FSRM, result.edx & (1 << 4));
+    }
+
+    cpuid(0x80000000, 0, &result);
+    if (result.eax >= 0x80000007) {
+        cpuid(0x80000007, 0, &result);
+        cpu_feature_set(CPU_FEATURE_INVARIANT_TSC, result.edx & (1 << 8));
+    }
+}
+
+bool cpu_has_feature(cpu_feature_t feature) {
+    if (feature >= CPU_FEATURE_COUNT) return false;
+    return (cpu_feature_bits >> feature) & 1;
+}
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/arch/idt.h>
+#include <core/arch/panic.h>
+#include <core/kernel/kstd.h>
+#include <stdbool.h>
+
+#define PIC1_CMD    0x20
+#define PIC1_DATA   0x21
+#define PIC2_CMD    0xA0
+#define PIC2_DATA   0xA1
+#define PIC_EOI     0x20
+#define PIC_READ_ISR 0x0B
+
+#define STUB_COUNT  (IRQ_BASE + IRQ_COUNT)
+
+typedef struct __attribute__((packed)) {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_high;
+    uint32_t reserved;
+} idt_entry_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t limit;
+    uint64_t base;
+} idt_ptr_t;
+
+static idt_entry_t idt[IDT_SIZE] __attribute__((aligned(16)));
+static irq_handler_t irq_handlers[IRQ_COUNT];
+static uint16_t irq_masks = 0xFFFF;
+
+extern uint64_t isr_stub_table[STUB_COUNT];
+
+static const char* const exception_names[IRQ_BASE] = {
+    "Divide error", "Debug", "NMI", "Breakpoint", "Overflow", "Bound range",
+    "Invalid opcode", "Device not available", "Double fault", "Coprocessor overrun",
+    "Invalid TSS", "Segment not present", "Stack fault", "General protection",
+    "Page fault", "Reserved", "x87 error", "Alignment check", "Machine check",
+    "SIMD error", "Virtualization", "Control protection", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Hypervisor injection",
+    "VMM communication", "Security", "Reserved"
+};
+
+static inline void io_wait(void) {
+    outb(0x80, 0);
+}
+
+static void pic_write_masks(void) {
+    outb(PIC1_DATA, irq_masks & 0xFF);
+    outb(PIC2_DATA, irq_masks >> 8);
+}
+
+static void pic_remap(void) {
+    outb(PIC1_CMD, 0x11);           // ICW1: init, ICW4 follows
+    io_wait();
+    outb(PIC2_CMD, 0x11);
+    io_wait();
+    outb(PIC1_DATA, IRQ_BASE);      // ICW2: vector offsets
+    io_wait();
+    outb(PIC2_DATA, IRQ_BASE + 8);
+    io_wait();
+    outb(PIC1_DATA, 0x04);          // ICW3: slave on IRQ2
+    io_wait();
+    outb(PIC2_DATA, 0x02);
+    io_wait();
+    outb(PIC1_DATA, 0x01);          // ICW4: 8086 mode
+    io_wait();
+    outb(PIC2_DATA, 0x01);
+    io_wait();
+    pic_write_masks();
+}
+
+void irq_mask(int irq) {
+    if (irq < 0 || irq >= IRQ_COUNT) return;
+    irq_masks |= 1 << irq;
+    pic_write_masks();
+}
+
+void irq_unmask(int irq) {
+    if (irq < 0 || irq >= IRQ_COUNT) return;
+    irq_masks &= ~(1 << irq);
+    if (irq >= 8) irq_masks &= ~(1 << 2);   // Cascade
+    pic_write_masks();
+}
+
+// Install handler for a PIC line and unmask it
+int irq_register(int irq, irq_handler_t handler) {
+    if (irq < 0 || irq >= IRQ_COUNT || !handler) return -1;
+    irq_handlers[irq] = handler;
+    irq_unmask(irq);
+    return 0;
+}
+
+// A spurious IRQ 7/15 is raised without the line's in-service bit set
+static bool irq_spurious(int irq) {
+    uint16_t port = irq == 7 ? PIC1_CMD : PIC2_CMD;
+    outb(port, PIC_READ_ISR);
+    return !(inb(port) & 0x80);
+}
+
+static void exception(interrupt_frame_t* frame) {
+    char message[160];
+    uint64_t cr2 = 0;
+    if (frame->vector == 14) {
+        asm volatile("mov %%cr2, %0" : "=r"(cr2));
+    }
+    snprintf(message, sizeof(message),
+             "CPU exception %llu (%s) error=0x%llx rip=%p rsp=%p cr2=%p\n",
+             (unsigned long long)frame->vector, exception_names[frame->vector],
+             (unsigned long long)frame->error, (void*)frame->rip,
+             (void*)frame->rsp, (void*)cr2);
+    panic(message);
+}
+
+void interrupt_dispatch(interrupt_frame_t* frame) {
+    if (frame->vector < IRQ_BASE) {
+        exception(frame);
+        return;
+    }
+
+    int irq = frame->vector - IRQ_BASE;
+    if ((irq == 7 || irq == 15) && irq_spurious(irq)) {
+        if (irq == 15) outb(PIC1_CMD, PIC_EOI);     // The master did see it
+        return;
+    }
+
+    if (irq_handlers[irq]) {
+        irq_handlers[irq]();
+    }
+
+    if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+static void idt_set_gate(int vector, uint64_t handler, uint16_t selector) {
+    idt_entry_t* entry = &idt[vector];
+    entry->offset_low = handler & 0xFFFF;
+    entry->selector = selector;
+    entry->ist = 0;
+    entry->type_attr = INTERRUPT_GATE;
+    entry->offset_mid = (handler >> 16) & 0xFFFF;
+    entry->offset_high = handler >> 32;
+    entry->reserved = 0;
+}
+
+// Interrupts stay disabled; call interrupts_enable() once handlers are set up
+void idt_init(void) {
+    // Gates use whatever code segment the bootloader's GDT put us in
+    uint16_t cs;
+    asm volatile("mov %%cs, %0" : "=r"(cs));
+
+    for (int i = 0; i < STUB_COUNT; i++) {
+        idt_set_gate(i, isr_stub_table[i], cs);
+    }
+
+    idt_ptr_t idtr = {
+        .limit = sizeof(idt) - 1,
+        .base = (uint64_t)idt,
+    };
+    asm volatile("lidt %0" :: "m"(idtr));
+
+    pic_remap();
+}
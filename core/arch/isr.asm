@@ -0,0 +1,165 @@
+; SPDX-License-Identifier: LGPL-3.0-or-later
+
+section .text
+bits 64
+
+extern interrupt_dispatch
+
+; Every stub leaves the same frame behind: vector and error code (a dummy
+; 0 where the CPU pushes none) on top of what the CPU pushed itself.
+%macro ISR_NOERR 1
+isr_stub_%1:
+    push qword 0
+    push qword %1
+    jmp isr_common
+%endmacro
+
+%macro ISR_ERR 1
+isr_stub_%1:
+    push qword %1
+    jmp isr_common
+%endmacro
+
+isr_common:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov rdi, rsp                ; interrupt_frame_t*, 16-byte aligned here
+    cld
+    call interrupt_dispatch
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+
+    add rsp, 16                 ; vector and error code
+    iretq
+
+; Exceptions 8, 10-14, 17, 21, 29 and 30 push an error code
+ISR_NOERR 0
+ISR_NOERR 1
+ISR_NOERR 2
+ISR_NOERR 3
+ISR_NOERR 4
+ISR_NOERR 5
+ISR_NOERR 6
+ISR_NOERR 7
+ISR_ERR   8
+ISR_NOERR 9
+ISR_ERR   10
+ISR_ERR   11
+ISR_ERR   12
+ISR_ERR   13
+ISR_ERR   14
+ISR_NOERR 15
+ISR_NOERR 16
+ISR_ERR   17
+ISR_NOERR 18
+ISR_NOERR 19
+ISR_NOERR 20
+ISR_ERR   21
+ISR_NOERR 22
+ISR_NOERR 23
+ISR_NOERR 24
+ISR_NOERR 25
+ISR_NOERR 26
+ISR_NOERR 27
+ISR_NOERR 28
+ISR_ERR   29
+ISR_ERR   30
+ISR_NOERR 31
+
+; Legacy PIC lines, remapped to 32-47
+ISR_NOERR 32
+ISR_NOERR 33
+ISR_NOERR 34
+ISR_NOERR 35
+ISR_NOERR 36
+ISR_NOERR 37
+ISR_NOERR 38
+ISR_NOERR 39
+ISR_NOERR 40
+ISR_NOERR 41
+ISR_NOERR 42
+ISR_NOERR 43
+ISR_NOERR 44
+ISR_NOERR 45
+ISR_NOERR 46
+ISR_NOERR 47
+
+section .data
+global isr_stub_table
+isr_stub_table:
+    dq isr_stub_0
+    dq isr_stub_1
+    dq isr_stub_2
+    dq isr_stub_3
+    dq isr_stub_4
+    dq isr_stub_5
+    dq isr_stub_6
+    dq isr_stub_7
+    dq isr_stub_8
+    dq isr_stub_9
+    dq isr_stub_10
+    dq isr_stub_11
+    dq isr_stub_12
+    dq isr_stub_13
+    dq isr_stub_14
+    dq isr_stub_15
+    dq isr_stub_16
+    dq isr_stub_17
+    dq isr_stub_18
+    dq isr_stub_19
+    dq isr_stub_20
+    dq isr_stub_21
+    dq isr_stub_22
+    dq isr_stub_23
+    dq isr_stub_24
+    dq isr_stub_25
+    dq isr_stub_26
+    dq isr_stub_27
+    dq isr_stub_28
+    dq isr_stub_29
+    dq isr_stub_30
+    dq isr_stub_31
+    dq isr_stub_32
+    dq isr_stub_33
+    dq isr_stub_34
+    dq isr_stub_35
+    dq isr_stub_36
+    dq isr_stub_37
+    dq isr_stub_38
+    dq isr_stub_39
+    dq isr_stub_40
+    dq isr_stub_41
+    dq isr_stub_42
+    dq isr_stub_43
+    dq isr_stub_44
+    dq isr_stub_45
+    dq isr_stub_46
+    dq isr_stub_47
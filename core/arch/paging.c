@@ -0,0 +1,337 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#define LOG_SUBSYSTEM LOG_SUBSYS_MEM
+
+#include <core/arch/paging.h>
+#include <core/arch/cpuid.h>
+#include <core/arch/msr.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/log.h>
+#include <lib/bootloader/limine.h>
+
+static volatile struct limine_executable_address_request kernel_address_request = {
+    .id = LIMINE_EXECUTABLE_ADDRESS_REQUEST_ID,
+    .revision = 0
+};
+
+// Provided by link.ld and boot.asm
+extern uint8_t __kernel_end[];
+extern uint8_t stack_guard[];
+
+#define PAGE_ADDR_MASK      0x000FFFFFFFFFF000ULL
+#define TABLE_ENTRIES       512
+#define TABLE_POOL_PAGES    16
+#define LOW_WINDOW_SIZE     (4ULL * 1024 * 1024 * 1024)
+
+// PAT slots: WB, WC, UC-, UC, repeated. Slot 1 (PWT only) becomes
+// write-combining instead of write-through; the other slots that plain
+// PWT/PCD combinations select keep their power-on meaning.
+#define PAT_LAYOUT          0x0007010600070106ULL
+
+static pml4_t* kernel_pml4 = NULL;
+static pml4_t* active_pml4 = NULL;
+static bool paging_enabled = false;
+
+static uint8_t* table_pool = NULL;
+static size_t table_pool_left = 0;
+static size_t tables_allocated = 0;
+
+static inline size_t pml4_index(uint64_t virt) { return (virt >> 39) & 0x1FF; }
+static inline size_t pdpt_index(uint64_t virt) { return (virt >> 30) & 0x1FF; }
+static inline size_t pd_index(uint64_t virt)   { return (virt >> 21) & 0x1FF; }
+static inline size_t pt_index(uint64_t virt)   { return (virt >> 12) & 0x1FF; }
+
+static inline void invlpg(uint64_t virt) {
+    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t value;
+    asm volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint64_t value) {
+    asm volatile("mov %0, %%cr4" :: "r"(value) : "memory");
+}
+
+// Page tables are carved out of the kernel heap in 64 KB chunks. The heap
+// lives in the HHDM, so a table's physical address is a subtraction away.
+static uint64_t* alloc_table(void) {
+    if (table_pool_left == 0) {
+        uint8_t* chunk = allocateMemory(TABLE_POOL_PAGES * PAGE_SIZE + PAGE_SIZE - 1);
+        if (!chunk) return NULL;
+
+        table_pool = (uint8_t*)(((uintptr_t)chunk + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+        table_pool_left = TABLE_POOL_PAGES;
+    }
+
+    uint64_t* table = (uint64_t*)table_pool;
+    table_pool += PAGE_SIZE;
+    table_pool_left--;
+    tables_allocated++;
+
+    memset(table, 0, PAGE_SIZE);
+    return table;
+}
+
+static inline uint64_t* entry_table(uint64_t entry) {
+    return (uint64_t*)physicalToVirtual(entry & PAGE_ADDR_MASK);
+}
+
+// Replace a 2 MB mapping by a page table with the same attributes, so a
+// single 4 KB page inside it can be changed.
+static uint64_t* split_huge_page(uint64_t* pde) {
+    uint64_t* pt = alloc_table();
+    if (!pt) return NULL;
+
+    uint64_t base = *pde & PAGE_ADDR_MASK & ~(PAGE_SIZE_2M - 1);
+    uint64_t flags = *pde & ~PAGE_ADDR_MASK & ~PAGE_HUGE;
+
+    for (size_t i = 0; i < TABLE_ENTRIES; i++) {
+        pt[i] = (base + i * PAGE_SIZE) | flags;
+    }
+
+    *pde = virtualToPhysical(pt) | PAGE_PRESENT | PAGE_WRITE | (flags & PAGE_USER);
+    return pt;
+}
+
+static uint64_t* next_table(uint64_t* table, size_t index, bool create, uint64_t flags) {
+    uint64_t entry = table[index];
+
+    if (entry & PAGE_PRESENT) {
+        if (entry & PAGE_HUGE) return NULL;
+        if (flags & PAGE_USER) table[index] |= PAGE_USER;
+        return entry_table(entry);
+    }
+
+    if (!create) return NULL;
+
+    uint64_t* next = alloc_table();
+    if (!next) return NULL;
+
+    table[index] = virtualToPhysical(next) | PAGE_PRESENT | PAGE_WRITE | (flags & PAGE_USER);
+    return next;
+}
+
+// Walk down to the page directory covering virt.
+static uint64_t* walk_to_pd(pml4_t* pml4, uint64_t virt, bool create, uint64_t flags) {
+    uint64_t* pdpt = next_table(pml4, pml4_index(virt), create, flags);
+    if (!pdpt) return NULL;
+    return next_table(pdpt, pdpt_index(virt), create, flags);
+}
+
+static void flush_page(pml4_t* pml4, uint64_t virt) {
+    if (paging_enabled && pml4 == active_pml4) {
+        invlpg(virt);
+    }
+}
+
+int paging_map_page(pml4_t* pml4, uint64_t virt, uint64_t phys, uint64_t flags) {
+    if (!pml4 || (virt & (PAGE_SIZE - 1)) || (phys & (PAGE_SIZE - 1))) return -1;
+
+    uint64_t* pd = walk_to_pd(pml4, virt, true, flags);
+    if (!pd) return -2;
+
+    uint64_t* pde = &pd[pd_index(virt)];
+    uint64_t* pt;
+    if ((*pde & PAGE_PRESENT) && (*pde & PAGE_HUGE)) {
+        pt = split_huge_page(pde);
+    } else {
+        pt = next_table(pd, pd_index(virt), true, flags);
+    }
+    if (!pt) return -2;
+
+    pt[pt_index(virt)] = phys | (flags & ~PAGE_HUGE) | PAGE_PRESENT;
+    flush_page(pml4, virt);
+    return 0;
+}
+
+static int map_huge_page(pml4_t* pml4, uint64_t virt, uint64_t phys, uint64_t flags) {
+    uint64_t* pd = walk_to_pd(pml4, virt, true, flags);
+    if (!pd) return -2;
+
+    uint64_t* pde = &pd[pd_index(virt)];
+
+    // Already split into 4 KB pages: let the caller fill it page by page
+    if ((*pde & PAGE_PRESENT) && !(*pde & PAGE_HUGE)) return -1;
+
+    *pde = phys | flags | PAGE_HUGE | PAGE_PRESENT;
+    flush_page(pml4, virt);
+    return 0;
+}
+
+int paging_map_range(pml4_t* pml4, uint64_t virt, uint64_t phys, size_t size, uint64_t flags) {
+    if ((virt & (PAGE_SIZE - 1)) != (phys & (PAGE_SIZE - 1))) return -1;
+
+    uint64_t offset = virt & (PAGE_SIZE - 1);
+    virt -= offset;
+    phys -= offset;
+    size = (size + offset + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+    while (size > 0) {
+        bool huge_ok = !(virt & (PAGE_SIZE_2M - 1)) &&
+                       !(phys & (PAGE_SIZE_2M - 1)) &&
+                       size >= PAGE_SIZE_2M;
+
+        if (huge_ok && map_huge_page(pml4, virt, phys, flags) == 0) {
+            virt += PAGE_SIZE_2M;
+            phys += PAGE_SIZE_2M;
+            size -= PAGE_SIZE_2M;
+            continue;
+        }
+
+        int ret = paging_map_page(pml4, virt, phys, flags);
+        if (ret != 0) return ret;
+
+        virt += PAGE_SIZE;
+        phys += PAGE_SIZE;
+        size -= PAGE_SIZE;
+    }
+
+    return 0;
+}
+
+int paging_unmap_page(pml4_t* pml4, uint64_t virt) {
+    if (!pml4) return -1;
+
+    uint64_t* pd = walk_to_pd(pml4, virt, false, 0);
+    if (!pd) return -1;
+
+    uint64_t* pde = &pd[pd_index(virt)];
+    if (!(*pde & PAGE_PRESENT)) return -1;
+
+    uint64_t* pt = (*pde & PAGE_HUGE) ? split_huge_page(pde) : entry_table(*pde);
+    if (!pt) return -2;
+
+    pt[pt_index(virt)] = 0;
+    flush_page(pml4, virt);
+    return 0;
+}
+
+uint64_t paging_virt_to_phys(pml4_t* pml4, uint64_t virt) {
+    if (!pml4) return (uint64_t)-1;
+
+    uint64_t* pd = walk_to_pd(pml4, virt, false, 0);
+    if (!pd) return (uint64_t)-1;
+
+    uint64_t pde = pd[pd_index(virt)];
+    if (!(pde & PAGE_PRESENT)) return (uint64_t)-1;
+    if (pde & PAGE_HUGE) {
+        return (pde & PAGE_ADDR_MASK & ~(PAGE_SIZE_2M - 1)) + (virt & (PAGE_SIZE_2M - 1));
+    }
+
+    uint64_t pte = entry_table(pde)[pt_index(virt)];
+    if (!(pte & PAGE_PRESENT)) return (uint64_t)-1;
+    return (pte & PAGE_ADDR_MASK) + (virt & (PAGE_SIZE - 1));
+}
+
+pml4_t* paging_kernel_pml4(void) {
+    return kernel_pml4;
+}
+
+bool paging_is_enabled(void) {
+    return paging_enabled;
+}
+
+pml4_t* paging_create_address_space(void) {
+    if (!kernel_pml4) return NULL;
+
+    pml4_t* pml4 = alloc_table();
+    if (!pml4) return NULL;
+
+    // Kernel half is shared: same PDPTs, so later kernel mappings show up
+    // in every address space.
+    for (size_t i = TABLE_ENTRIES / 2; i < TABLE_ENTRIES; i++) {
+        pml4[i] = kernel_pml4[i];
+    }
+    return pml4;
+}
+
+void paging_switch(pml4_t* pml4) {
+    if (!pml4) return;
+    asm volatile("mov %0, %%cr3" :: "r"(virtualToPhysical(pml4)) : "memory");
+    active_pml4 = pml4;
+}
+
+void paging_init(void) {
+    if (read_cr4() & (1ULL << 12)) {
+        LOG_WARN("Paging: 5-level paging active, keeping bootloader tables\n");
+        return;
+    }
+
+    struct limine_executable_address_response* kaddr = kernel_address_request.response;
+    struct limine_memmap_response* memmap = getMemoryMap();
+    if (!kaddr || !memmap) {
+        LOG_WARN("Paging: bootloader did not report kernel address or memory map\n");
+        return;
+    }
+
+    kernel_pml4 = alloc_table();
+    if (!kernel_pml4) {
+        LOG_WARN("Paging: out of memory for page tables\n");
+        return;
+    }
+
+    uint64_t hhdm = (uint64_t)physicalToVirtual(0);
+
+    // The bootloader identity-maps the low 4 GiB and LOAD_ABS/STORE_ABS in
+    // NVM rely on it, so keep that window. The HHDM gets 2 MB pages.
+    paging_map_range(kernel_pml4, 0, 0, LOW_WINDOW_SIZE, PAGE_PRESENT | PAGE_WRITE);
+    paging_map_range(kernel_pml4, hhdm, 0, LOW_WINDOW_SIZE, PAGE_KERNEL);
+
+    for (size_t i = 0; i < memmap->entry_count; i++) {
+        struct limine_memmap_entry* entry = memmap->entries[i];
+        if (entry->type == LIMINE_MEMMAP_BAD_MEMORY) continue;
+
+        uint64_t start = entry->base & ~(PAGE_SIZE_2M - 1);
+        uint64_t end = (entry->base + entry->length + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1);
+        if (start < LOW_WINDOW_SIZE) start = LOW_WINDOW_SIZE;
+        if (end <= start) continue;
+
+        paging_map_range(kernel_pml4, hhdm + start, start, end - start, PAGE_KERNEL);
+    }
+
+    // Framebuffer goes last so its memory type wins over the WB mappings
+    // above; 2 MB pages that only partly cover it are split.
+    bool has_pat = cpu_has_feature(CPU_FEATURE_PAT);
+    for (size_t i = 0; i < memmap->entry_count; i++) {
+        struct limine_memmap_entry* entry = memmap->entries[i];
+        if (entry->type != LIMINE_MEMMAP_FRAMEBUFFER) continue;
+
+        uint64_t cache = has_pat ? PAGE_CACHE_WC : PAGE_CACHE_UC;
+        paging_map_range(kernel_pml4, hhdm + entry->base, entry->base, entry->length,
+                         PAGE_KERNEL | cache);
+    }
+
+    uint64_t kernel_size = (uint64_t)__kernel_end - kaddr->virtual_base;
+    paging_map_range(kernel_pml4, kaddr->virtual_base, kaddr->physical_base,
+                     kernel_size, PAGE_KERNEL);
+
+    // Guard page below the boot stack: an overflow now faults instead of
+    // silently overwriting .bss.
+    paging_unmap_page(kernel_pml4, (uint64_t)stack_guard);
+
+    if (has_pat) {
+        asm volatile("wbinvd" ::: "memory");
+        wrmsr(MSR_IA32_PAT, PAT_LAYOUT);
+    }
+
+    paging_switch(kernel_pml4);
+
+    // Reloading CR3 keeps global entries from the old tables; toggling
+    // CR4.PGE drops them.
+    uint64_t cr4 = read_cr4();
+    if (cr4 & (1ULL << 7)) {
+        write_cr4(cr4 & ~(1ULL << 7));
+        write_cr4(cr4);
+    }
+
+    if (has_pat) {
+        asm volatile("wbinvd" ::: "memory");
+    }
+
+    paging_enabled = true;
+    LOG_INFO("Paging: kernel page tables active (%d tables, framebuffer %s)\n",
+             (int)tables_allocated, has_pat ? "WC" : "UC");
+}
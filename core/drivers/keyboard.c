@@ -3,6 +3,7 @@
 #include <core/drivers/keyboard.h>
 #include <core/kernel/kstd.h>
 #include <core/kernel/vge/fb.h>
+#include <core/kernel/log.h>
 
 extern uint8_t inb(uint16_t port);
 extern void outb(uint16_t port, uint8_t val);
@@ -151,8 +152,9 @@ char keyboard_getchar(void) {
     
     while (!keyboard_has_char()) {
         keyboard_poll();
-        // Run NVM scheduler while waiting for input
+        // Run NVM scheduler and flush queued log records while waiting for input
         nvm_scheduler_tick();
+        log_drain();
     }
     return keyboard_buffer_pop();
 }
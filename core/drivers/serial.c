@@ -1,18 +1,100 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include <core/drivers/serial.h>
+#include <core/arch/idt.h>
+#include <core/arch/pause.h>
 #include <core/kernel/vge/fb_render.h>
 
-// Assuming outb and inb functions are defined elsewhere
-extern void outb(unsigned short port, unsigned char val);
-extern unsigned char inb(unsigned short port);
+#define UART_DATA   0
+#define UART_IER    1
+#define UART_IIR    2       // Read
+#define UART_FCR    2       // Write
+#define UART_LCR    3
+#define UART_MCR    4
+#define UART_LSR    5
+
+#define IER_RX      0x01
+#define IER_THRE    0x02
+#define LSR_DR      0x01
+#define LSR_THRE    0x20
+
+#define SERIAL_CLOCK 115200     // Input clock / 16, i.e. divisor 1
+
+// Rings use free-running indices; head is written by the producer only,
+// tail by the consumer only, and both are touched with interrupts off.
+static char tx_ring[SERIAL_TX_SIZE];
+static uint32_t tx_head = 0;
+static uint32_t tx_tail = 0;
+static char rx_ring[SERIAL_RX_SIZE];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+
+static bool serial_present = false;
+static bool irq_mode = false;
+
+// Refill the UART from the TX ring. THRE means the whole FIFO is empty, so
+// up to SERIAL_FIFO_SIZE bytes go out without polling between them. With
+// interrupts on, THRE is armed only while there is something left to send.
+static void tx_pump(void) {
+    if (inb(PORT + UART_LSR) & LSR_THRE) {
+        for (int i = 0; i < SERIAL_FIFO_SIZE && tx_tail != tx_head; i++) {
+            outb(PORT + UART_DATA, tx_ring[tx_tail++ & (SERIAL_TX_SIZE - 1)]);
+        }
+    }
+    if (irq_mode) {
+        outb(PORT + UART_IER, tx_tail != tx_head ? IER_RX | IER_THRE : IER_RX);
+    }
+}
+
+static void rx_pump(void) {
+    while (inb(PORT + UART_LSR) & LSR_DR) {
+        char c = inb(PORT + UART_DATA);
+        if (rx_head - rx_tail < SERIAL_RX_SIZE) {
+            rx_ring[rx_head++ & (SERIAL_RX_SIZE - 1)] = c;
+        }
+    }
+}
+
+static void serial_irq(void) {
+    uint8_t iir;
+    while (!((iir = inb(PORT + UART_IIR)) & 0x01)) {
+        switch (iir & 0x0E) {
+            case 0x04:                      // Received data
+            case 0x0C:                      // Character timeout
+                rx_pump();
+                break;
+            case 0x02:                      // Transmitter empty
+                tx_pump();
+                break;
+            case 0x06:                      // Line status
+                inb(PORT + UART_LSR);
+                break;
+            default:                        // Modem status
+                inb(PORT + 6);
+                break;
+        }
+    }
+}
+
+// Baud rates that divide 115200 evenly, up to 115200 itself
+int serial_set_baud(uint32_t baud) {
+    if (baud == 0 || baud > SERIAL_CLOCK || SERIAL_CLOCK % baud) return -1;
+    uint16_t divisor = SERIAL_CLOCK / baud;
+
+    uint64_t flags = irq_save();
+    uint8_t lcr = inb(PORT + UART_LCR);
+    outb(PORT + UART_LCR, lcr | 0x80);          // DLAB on
+    outb(PORT + 0, divisor & 0xFF);
+    outb(PORT + 1, divisor >> 8);
+    outb(PORT + UART_LCR, lcr & ~0x80);
+    irq_restore(flags);
+    return 0;
+}
 
 int init_serial() {
     outb(PORT + 1, 0x00);    // Disable all interrupts
-    outb(PORT + 3, 0x80);    // Enable DLAB (set baud rate divisor)
-    outb(PORT + 0, 0x03);    // Set divisor to 3 (lo byte) 38400 baud
-    outb(PORT + 1, 0x00);    //                  (hi byte)
     outb(PORT + 3, 0x03);    // 8 bits, no parity, one stop bit
+    serial_set_baud(SERIAL_BAUD);
     outb(PORT + 2, 0xC7);    // Enable FIFO, clear them, with 14-byte threshold
     outb(PORT + 4, 0x0B);    // IRQs enabled, RTS/DSR set
     outb(PORT + 4, 0x1E);    // Set in loopback mode, test the serial chip
@@ -26,19 +108,67 @@ int init_serial() {
     // If serial is not faulty set it in normal operation mode
     // (not-loopback with IRQs enabled and OUT#1 and OUT#2 bits enabled)
     outb(PORT + 4, 0x0F);
+    serial_present = true;
+
+    // OUT2 gates the UART onto IRQ 4; the IDT must already be loaded
+    if (irq_register(IRQ_COM1, serial_irq) == 0) {
+        irq_mode = true;
+        outb(PORT + UART_IER, IER_RX);
+    }
+
     kprint(":: Serial initialized\n", 7);
     
     return 0;
 }
 
+size_t serial_tx_free(void) {
+    return SERIAL_TX_SIZE - (tx_head - tx_tail);
+}
+
+// Queue as much of buf as fits and return how much that was; never waits
+size_t serial_write(const char* buf, size_t len) {
+    if (!serial_present) return len;
+
+    uint64_t flags = irq_save();
+    size_t space = SERIAL_TX_SIZE - (tx_head - tx_tail);
+    if (len > space) len = space;
+    for (size_t i = 0; i < len; i++) {
+        tx_ring[tx_head++ & (SERIAL_TX_SIZE - 1)] = buf[i];
+    }
+    tx_pump();
+    irq_restore(flags);
+    return len;
+}
+
+// Wait until everything queued has gone out. Polls the UART itself, so it
+// also works with interrupts disabled (early boot, panic).
+void serial_flush(void) {
+    while (serial_present && tx_tail != tx_head) {
+        uint64_t flags = irq_save();
+        tx_pump();
+        irq_restore(flags);
+        cpu_relax();
+    }
+}
+
 int serial_received() {
+    if (irq_mode) return rx_head != rx_tail;
     return inb(PORT + 5) & 1;
 }
 
 char read_serial() {
-    while (serial_received() == 0);
+    if (!irq_mode) {
+        while (serial_received() == 0);
+        return inb(PORT);
+    }
 
-    return inb(PORT);
+    while (rx_head == rx_tail) {
+        cpu_relax();
+    }
+    uint64_t flags = irq_save();
+    char c = rx_ring[rx_tail++ & (SERIAL_RX_SIZE - 1)];
+    irq_restore(flags);
+    return c;
 }
 
 int is_transmit_empty() {
@@ -46,13 +176,21 @@ int is_transmit_empty() {
 }
 
 void write_serial(char a) {
-    while (is_transmit_empty() == 0);
-
-    outb(PORT, a);
+    serial_print((char[]){a, '\0'});
 }
 
+// Blocks only while the TX ring is full
 void serial_print(const char* str) {
-    while (*str) {
-        write_serial(*str++);
+    size_t len = strlen(str);
+    while (len > 0) {
+        size_t sent = serial_write(str, len);
+        str += sent;
+        len -= sent;
+        if (len > 0) {
+            uint64_t flags = irq_save();
+            tx_pump();
+            irq_restore(flags);
+            cpu_relax();
+        }
     }
 }
\ No newline at end of file
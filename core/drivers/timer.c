@@ -3,6 +3,7 @@
 #include <core/drivers/timer.h>
 #include <core/kernel/vge/fb_render.h>
 #include <core/arch/idt.h>
+#include <core/kernel/ktime.h>
 
 void pit_init() {
     int16_t divisor = 1193182 / 1000; // 1000 Hz
@@ -12,6 +13,10 @@ void pit_init() {
     kprint(":: PIT Setup\n", 7);
 }
 
+uint64_t get_uptime(void) {
+    return ktime_ns() / NSEC_PER_SEC;
+}
+
 void pit_polling_loop() {
     static int16_t last_count = 0xFFFF;
     while (1) {
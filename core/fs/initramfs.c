@@ -1,183 +1,118 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
+#define LOG_SUBSYSTEM LOG_SUBSYS_VFS
+
 #include <core/fs/initramfs.h>
-#include <core/fs/ramfs.h>
 
 #include <core/kernel/mem.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <core/kernel/kstd.h>
+#include <core/kernel/log.h>
+#include <core/kernel/lz4.h>
 #include <core/kernel/vge/fb_render.h>
-#include <core/kernel/mem.h>
 
 #define MAX_PROGRAMS 64
+#define INDEX_SLOTS  128   // Power of two, at most half full
 
 static struct program programs[MAX_PROGRAMS];
 static size_t program_count = 0;
 
+// Open-addressing index from name hash to programs[] slot (-1 = empty)
+static int16_t name_index[INDEX_SLOTS];
+
+static uint32_t fnv1a(const void* data, size_t len) {
+    const uint8_t* p = data;
+    uint32_t hash = 0x811c9dc5;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+static void index_insert(int idx) {
+    const char* name = programs[idx].name;
+    size_t i = fnv1a(name, strlen(name)) & (INDEX_SLOTS - 1);
+    while (name_index[i] >= 0) {
+        i = (i + 1) & (INDEX_SLOTS - 1);
+    }
+    name_index[i] = idx;
+}
+
 void initramfs_load(struct limine_module_request* module_request) {
     initramfs_load_limine(module_request);
 }
 
 void initramfs_load_from_memory(void* initramfs_data, size_t initramfs_size) {
+    program_count = 0;
+    for (int i = 0; i < INDEX_SLOTS; i++) {
+        name_index[i] = -1;
+    }
+
     if (!initramfs_data || initramfs_size == 0) {
         kprint("No initramfs data provided\n", 14);
         return;
     }
 
-    int8_t *data = (int8_t*)initramfs_data;
+    const char* image = initramfs_data;
+    const struct initramfs_header* header = initramfs_data;
 
-    kprint(":: Loading initramfs from memory\n", 7); // (size=%d)..\n", 7, initramfs_size);
+    if (initramfs_size < sizeof(*header) || memcmp(header->magic, INITRAMFS_MAGIC, 4) != 0) {
+        kprint("Initramfs has no NVRD header, rebuild it with initramfs-rebuild.rb\n", 14);
+        return;
+    }
+    if (header->version != INITRAMFS_VERSION) {
+        LOG_WARN("initramfs: unsupported version %d\n", header->version);
+        return;
+    }
 
-    // Reset program count for this loading
-    program_count = 0;
-    size_t offset = 0;
+    size_t count = header->count;
+    if (sizeof(*header) + count * sizeof(struct initramfs_entry) > initramfs_size) {
+        kprint("Initramfs table of contents is truncated\n", 14);
+        return;
+    }
+    if (count > MAX_PROGRAMS) {
+        LOG_WARN("initramfs: %d programs, only the first %d are used\n", (int)count, MAX_PROGRAMS);
+        count = MAX_PROGRAMS;
+    }
 
-    while (offset < initramfs_size && program_count < MAX_PROGRAMS) {
-        if (offset + 4 > initramfs_size) {
-            kprint("Incomplete size field in initramfs\n", 14);
-            break;
-        }
+    const struct initramfs_entry* entries = (const struct initramfs_entry*)(header + 1);
 
-        int32_t prog_size = 0;
-        for (int i = 0; i < 4; i++) {
-            prog_size = (prog_size << 8) | data[offset++];
-        }
+    for (size_t i = 0; i < count; i++) {
+        const struct initramfs_entry* entry = &entries[i];
 
-        if (prog_size == 0) {
-            kprint("Zero-sized program encountered\n", 14);
-            break;
+        if (memchr(entry->name, '\0', INITRAMFS_NAME_MAX) == NULL || entry->name[0] == '\0') {
+            LOG_WARN("initramfs: entry %d has a bad name\n", (int)i);
+            continue;
         }
-
-        if (prog_size > initramfs_size - offset) {
-            kprint("Program size exceeds available data\n", 14);
-            break;
+        if ((uint64_t)entry->offset + entry->stored_size > initramfs_size ||
+            (!(entry->flags & INITRAMFS_FLAG_LZ4) && entry->stored_size != entry->size)) {
+            LOG_WARN("initramfs: %s exceeds the image\n", entry->name);
+            continue;
         }
-
-        programs[program_count].data = (const char*)&data[offset];
-        programs[program_count].size = prog_size;
-        programs[program_count].ramfs_sector = -1;
-
-        int sector = ramfs_write((const char*)&data[offset], prog_size);
-        if (sector >= 0) {
-            programs[program_count].ramfs_sector = sector;
-
-            kprint(":: Loaded program ", 7);
-
-            char buf[16];
-            memset(buf, 0, sizeof(buf));
-            size_t n = program_count;
-            char* p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-
-            kprint(" (size=", 7);
-
-            memset(buf, 0, sizeof(buf));
-            n = prog_size;
-            p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-            kprint(", sector=", 7);
-
-            memset(buf, 0, sizeof(buf));
-            n = sector;
-            p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-            kprint(")\n", 7);
-        } else {
-            kprint("Failed to load program to RamFS\n", 14);
+        if (initramfs_find(entry->name)) {
+            LOG_WARN("initramfs: duplicate program %s\n", entry->name);
+            continue;
         }
 
-        program_count++;
-        offset += prog_size;
+        struct program* prog = &programs[program_count];
+        prog->name = entry->name;
+        prog->stored = image + entry->offset;
+        prog->stored_size = entry->stored_size;
+        prog->data = (entry->flags & INITRAMFS_FLAG_LZ4) ? NULL : prog->stored;
+        prog->size = entry->size;
+        prog->flags = entry->flags;
+        prog->checksum = entry->checksum;
+        prog->verified = 0;
 
-        if (offset % 4 != 0) {
-            offset += 4 - (offset % 4);
-        }
+        index_insert(program_count);
+        program_count++;
+        LOG_DEBUG("initramfs: %s (%d bytes, %d stored)\n", prog->name, (int)prog->size, (int)prog->stored_size);
     }
 
-    kprint(":: Total programs loaded: ", 7);
-    char count_buf[16];
-    memset(count_buf, 0, sizeof(count_buf));
-    size_t n = program_count;
-    char* p = count_buf;
-    if (n == 0) {
-        *p++ = '0';
-    } else {
-        char* start = p;
-        while (n > 0) {
-            *p++ = '0' + n % 10;
-            n /= 10;
-        }
-        p--;
-        while (start < p) {
-            char temp = *start;
-            *start = *p;
-            *p = temp;
-            start++;
-            p--;
-        }
-        p = count_buf + 15;
-    }
-    *p = '\0';
+    char count_buf[48];
+    snprintf(count_buf, sizeof(count_buf), ":: Initramfs programs: %d\n", (int)program_count);
     kprint(count_buf, 7);
-    kprint("\n", 7);
 }
 
 void initramfs_load_limine(volatile struct limine_module_request* module_request) {
@@ -186,226 +121,68 @@ void initramfs_load_limine(volatile struct limine_module_request* module_request
         return;
     }
 
-    // Find initramfs module (skip ISO if present)
-    struct limine_file* initramfs_module = NULL;
     for (uint64_t i = 0; i < module_request->response->module_count; i++) {
         struct limine_file* module = module_request->response->modules[i];
-        // Skip modules that are too small to be initramfs
-        if (module->size > 1024) {  // Minimum reasonable size
-            initramfs_module = module;
-            break;
+        if (module->size >= sizeof(struct initramfs_header) &&
+            memcmp(module->address, INITRAMFS_MAGIC, 4) == 0) {
+            initramfs_load_from_memory(module->address, module->size);
+            return;
         }
     }
 
-    if (!initramfs_module) {
-        kprint("No suitable initramfs module found\n", 14);
-        return;
+    kprint("No suitable initramfs module found\n", 14);
+}
+
+struct program* initramfs_get_program(size_t index) {
+    if (index >= program_count) return NULL;
+    return &programs[index];
+}
+
+struct program* initramfs_find(const char* name) {
+    size_t i = fnv1a(name, strlen(name)) & (INDEX_SLOTS - 1);
+    while (name_index[i] >= 0) {
+        struct program* prog = &programs[name_index[i]];
+        if (strcmp(prog->name, name) == 0) return prog;
+        i = (i + 1) & (INDEX_SLOTS - 1);
     }
+    return NULL;
+}
 
-    int8_t *initramfs_data = (int8_t*)initramfs_module->address;
-    size_t initramfs_size = initramfs_module->size;
-    
-    kprint(":: Loading initramfs..\n", 7);
-    
-    size_t offset = 0;
-    program_count = 0;
-    
-    while (offset < initramfs_size && program_count < MAX_PROGRAMS) {
-        if (offset + 4 > initramfs_size) {
-            kprint("Incomplete size field in initramfs\n", 14);
-            break;
-        }
-        
-        int32_t prog_size = 0;
-        for (int i = 0; i < 4; i++) {
-            prog_size = (prog_size << 8) | initramfs_data[offset++];
-        }
-        
-        if (prog_size == 0) {
-            kprint("Zero-sized program encountered\n", 14);
-            break;
-        }
-        
-        if (prog_size > initramfs_size - offset) {
-            kprint("Program size exceeds available data\n", 14);
-            break;
-        }
-        
-        programs[program_count].data = (const char*)&initramfs_data[offset];
-        programs[program_count].size = prog_size;
-        programs[program_count].ramfs_sector = -1;
-        
-        int sector = ramfs_write((const char*)&initramfs_data[offset], prog_size);
-        if (sector >= 0) {
-            programs[program_count].ramfs_sector = sector;
-            
-            kprint(":: Loaded program ", 7);
-            
-            char buf[16];
-            memset(buf, 0, sizeof(buf));
-            size_t n = program_count;
-            char* p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-            
-            kprint(" (size=", 7);
-            
-            memset(buf, 0, sizeof(buf));
-            n = prog_size;
-            p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-            kprint(", sector=", 7);
-            
-            memset(buf, 0, sizeof(buf));
-            n = sector;
-            p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-            kprint(")\n", 7);
-        } else {
-            kprint("Failed to load program to RamFS\n", 14);
-        }
-        
-        program_count++;
-        offset += prog_size;
-        
-        if (offset % 4 != 0) {
-            offset += 4 - (offset % 4);
-        }
+static bool inflate(struct program* prog) {
+    char* buf = kmalloc(prog->size ? prog->size : 1);
+    if (!buf) {
+        LOG_WARN("initramfs: no memory to decompress %s\n", prog->name);
+        return false;
     }
 
-    kprint(":: Total programs loaded: ", 7);
-    char count_buf[16];
-    memset(count_buf, 0, sizeof(count_buf));
-    size_t n = program_count;
-    char* p = count_buf;
-    if (n == 0) {
-        *p++ = '0';
-    } else {
-        char* start = p;
-        while (n > 0) {
-            *p++ = '0' + n % 10;
-            n /= 10;
-        }
-        p--;
-        while (start < p) {
-            char temp = *start;
-            *start = *p;
-            *p = temp;
-            start++;
-            p--;
-        }
-        p = count_buf + 15;
+    long got = lz4_decompress(prog->stored, prog->stored_size, buf, prog->size);
+    if (got != (long)prog->size) {
+        LOG_WARN("initramfs: %s is not a valid LZ4 block\n", prog->name);
+        kfree(buf);
+        return false;
     }
-    *p = '\0';
-    kprint(count_buf, 7);
-    kprint("\n", 7);
 
-    // Debug: ensure program_count is set
-    kprint(":: Debug: program_count set to ", 7);
-    memset(count_buf, 0, sizeof(count_buf));
-    n = program_count;
-    p = count_buf;
-    if (n == 0) {
-        *p++ = '0';
-    } else {
-        char* start = p;
-        while (n > 0) {
-            *p++ = '0' + n % 10;
-            n /= 10;
+    prog->data = buf;
+    return true;
+}
+
+// Make prog->data usable. Decompression and the checksum both happen on
+// first use rather than at boot, so untouched programs cost nothing.
+bool initramfs_open(struct program* prog) {
+    if (prog->verified == 0) {
+        if (!prog->data && !inflate(prog)) {
+            prog->verified = -1;
+            return false;
         }
-        p--;
-        while (start < p) {
-            char temp = *start;
-            *start = *p;
-            *p = temp;
-            start++;
-            p--;
+
+        prog->verified = fnv1a(prog->data, prog->size) == prog->checksum ? 1 : -1;
+        if (prog->verified < 0) {
+            LOG_WARN("initramfs: checksum mismatch in %s\n", prog->name);
         }
-        p = count_buf + 15;
     }
-    *p = '\0';
-    kprint(count_buf, 7);
-    kprint("\n", 7);
-}
-
-struct program* initramfs_get_program(size_t index) {
-    if (index >= program_count) return NULL;
-    return &programs[index];
+    return prog->verified > 0;
 }
 
 size_t initramfs_get_count(void) {
     return program_count;
 }
-
-int initramfs_load_to_ramfs(size_t index) {
-    if (index >= program_count) return -1;
-    
-    struct program* prog = &programs[index];
-    
-    if (prog->ramfs_sector >= 0) {
-        return prog->ramfs_sector;
-    }
-
-    int sector = ramfs_write(prog->data, prog->size);
-    if (sector >= 0) {
-        prog->ramfs_sector = sector;
-    }
-    
-    return sector;
-}
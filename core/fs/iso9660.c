@@ -52,31 +52,159 @@ static void to_lowercase(char* str) {
     }
 }
 
-static iso9660_dir_entry_t* find_entry_in_dir(uint32_t dir_extent, uint32_t dir_size, const char* name) {
-    const uint8_t* dir_data = read_block(dir_extent);
-    if (!dir_data) return NULL;
+// Next real entry of a directory extent at or after *offset, or NULL.
+// Records never cross a logical block, so a zero length means "skip to the
+// next block"; "." and ".." are skipped. A record that does not fit in the
+// extent, or is too short for its own name, ends the walk.
+static const iso9660_dir_entry_t* next_dir_entry(const uint8_t* dir_data, uint32_t dir_size, size_t* offset) {
+    while (*offset < dir_size) {
+        const iso9660_dir_entry_t* entry = (const iso9660_dir_entry_t*)(dir_data + *offset);
+
+        if (entry->length == 0) {
+            *offset = (*offset / block_size + 1) * block_size;
+            continue;
+        }
+        if (*offset + sizeof(*entry) > dir_size ||
+            *offset + entry->length > dir_size ||
+            entry->length < sizeof(*entry) + entry->name_len) {
+            return NULL;
+        }
+        *offset += entry->length;
+
+        const char* entry_name = (const char*)(entry + 1);
+        if (entry->name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
+            continue;
+        }
+        return entry;
+    }
+    return NULL;
+}
+
+// Name index: (parent directory extent, lowercased name) -> entry, built
+// once from the path table so deep lookups are one probe per component.
+typedef struct {
+    uint32_t parent;
+    uint32_t hash;
+    const iso9660_dir_entry_t* entry;
+} iso_index_slot_t;
+
+static iso_index_slot_t* name_index = NULL;
+static size_t name_index_slots = 0;
+
+static uint32_t iso_name_hash(uint32_t parent, const char* name) {
+    uint32_t hash = 2166136261u ^ parent;
+    for (size_t i = 0; name[i]; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void entry_lower_name(const iso9660_dir_entry_t* entry, char* out, size_t out_size) {
+    normalize_filename((const char*)(entry + 1), entry->name_len, out, out_size);
+    to_lowercase(out);
+}
 
+static const uint8_t* dir_extent_data(uint32_t extent, uint32_t* size) {
+    const iso9660_dir_entry_t* self = (const iso9660_dir_entry_t*)read_block(extent);
+    size_t start = (size_t)extent * block_size;
+    if (!self || start + sizeof(*self) > iso_data_size || start + self->size_le > iso_data_size) {
+        return NULL;
+    }
+    *size = self->size_le;
+    return (const uint8_t*)self;
+}
+
+// Calls fn for every entry of every directory listed in the L path table
+static size_t walk_path_table(void (*fn)(uint32_t parent, const iso9660_dir_entry_t* entry)) {
+    const uint8_t* table = read_block(primary_volume->type_l_path_table);
+    uint32_t table_size = primary_volume->path_table_size_le;
+    if (!table || (size_t)primary_volume->type_l_path_table * block_size + table_size > iso_data_size) {
+        return 0;
+    }
+
+    size_t entries = 0;
     size_t offset = 0;
-    while (offset < dir_size) {
-        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)(dir_data + offset);
-        if (entry->length == 0) break;
+    while (offset + 8 <= table_size) {
+        uint8_t name_len = table[offset];
+        if (name_len == 0) break;
+
+        uint32_t extent = *(const uint32_t*)(table + offset + 2);
+        offset += 8 + name_len + (name_len & 1);
+
+        uint32_t dir_size;
+        const uint8_t* dir_data = dir_extent_data(extent, &dir_size);
+        if (!dir_data) continue;
+
+        size_t pos = 0;
+        const iso9660_dir_entry_t* entry;
+        while ((entry = next_dir_entry(dir_data, dir_size, &pos)) != NULL) {
+            if (fn) fn(extent, entry);
+            entries++;
+        }
+    }
+    return entries;
+}
 
-        char* entry_name = (char*)(entry + 1);
-        uint8_t name_len = entry->name_len;
+static void index_insert(uint32_t parent, const iso9660_dir_entry_t* entry) {
+    char name[256];
+    entry_lower_name(entry, name, sizeof(name));
 
-        if (name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
-            offset += entry->length;
-            continue;
+    uint32_t hash = iso_name_hash(parent, name);
+    size_t mask = name_index_slots - 1;
+    size_t i = hash & mask;
+    while (name_index[i].entry) {
+        i = (i + 1) & mask;
+    }
+    name_index[i].parent = parent;
+    name_index[i].hash = hash;
+    name_index[i].entry = entry;
+}
+
+static void build_name_index(void) {
+    size_t count = walk_path_table(NULL);
+    if (count == 0) return;
+
+    size_t slots = 16;
+    while (slots < count * 2) slots *= 2;
+
+    name_index = kmalloc(slots * sizeof(iso_index_slot_t));
+    if (!name_index) return;
+    memset(name_index, 0, slots * sizeof(iso_index_slot_t));
+    name_index_slots = slots;
+
+    walk_path_table(index_insert);
+}
+
+// name must already be lowercased
+static const iso9660_dir_entry_t* find_entry_in_dir(uint32_t dir_extent, const char* name) {
+    char normalized[256];
+
+    if (name_index) {
+        uint32_t hash = iso_name_hash(dir_extent, name);
+        size_t mask = name_index_slots - 1;
+        for (size_t i = hash & mask; name_index[i].entry; i = (i + 1) & mask) {
+            if (name_index[i].hash != hash || name_index[i].parent != dir_extent) continue;
+            entry_lower_name(name_index[i].entry, normalized, sizeof(normalized));
+            if (strcmp(normalized, name) == 0) {
+                return name_index[i].entry;
+            }
         }
+        return NULL;
+    }
 
-        char normalized[256];
-        normalize_filename(entry_name, name_len, normalized, sizeof(normalized));
+    // No usable path table: scan the whole extent
+    uint32_t dir_size;
+    const uint8_t* dir_data = dir_extent_data(dir_extent, &dir_size);
+    if (!dir_data) return NULL;
 
+    size_t offset = 0;
+    const iso9660_dir_entry_t* entry;
+    while ((entry = next_dir_entry(dir_data, dir_size, &offset)) != NULL) {
+        entry_lower_name(entry, normalized, sizeof(normalized));
         if (strcmp(normalized, name) == 0) {
             return entry;
         }
-
-        offset += entry->length;
     }
 
     return NULL;
@@ -96,6 +224,7 @@ void iso9660_init(void* iso_start, size_t iso_size) {
             primary_volume = vd;
             block_size = vd->logical_block_size_le;
             initialized = true;
+            build_name_index();
             return;
         }
 
@@ -130,11 +259,6 @@ const void* iso9660_find_file(const char* path, size_t* size) {
     char* search_path = path_copy;
     if (search_path[0] == '/') search_path++;
 
-    if (search_path[0] == '\0') {
-        if (size) *size = current_size;
-        return read_block(current_extent);
-    }
-
     char* token = search_path;
     while (*token) {
         char* next_slash = token;
@@ -150,8 +274,9 @@ const void* iso9660_find_file(const char* path, size_t* size) {
             component[k] = token[k];
         }
         component[comp_len] = '\0';
+        to_lowercase(component);
 
-        iso9660_dir_entry_t* entry = find_entry_in_dir(current_extent, current_size, component);
+        const iso9660_dir_entry_t* entry = find_entry_in_dir(current_extent, component);
         if (!entry) {
             if (size) *size = 0;
             return NULL;
@@ -164,6 +289,10 @@ const void* iso9660_find_file(const char* path, size_t* size) {
         if (*token == '/') token++;
     }
 
+    if ((size_t)current_extent * block_size + current_size > iso_data_size) {
+        if (size) *size = 0;
+        return NULL;
+    }
     if (size) *size = current_size;
     return read_block(current_extent);
 }
@@ -189,18 +318,11 @@ void iso9660_list_dir(const char* path) {
     kprint(":\n", 7);
 
     size_t offset = 0;
-    while (offset < dir_size) {
-        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)(dir_data + offset);
-        if (entry->length == 0) break;
-
-        char* entry_name = (char*)(entry + 1);
+    const iso9660_dir_entry_t* entry;
+    while ((entry = next_dir_entry(dir_data, dir_size, &offset)) != NULL) {
+        const char* entry_name = (const char*)(entry + 1);
         uint8_t name_len = entry->name_len;
 
-        if (name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
-            offset += entry->length;
-            continue;
-        }
-
         char normalized[256];
         normalize_filename(entry_name, name_len, normalized, sizeof(normalized));
 
@@ -220,8 +342,6 @@ void iso9660_list_dir(const char* path) {
             kprint(" bytes)", 7);
         }
         kprint("\n", 7);
-
-        offset += entry->length;
     }
 }
 
@@ -229,51 +349,40 @@ bool iso9660_is_initialized(void) {
     return initialized;
 }
 
-static void mount_dir_recursive(const char* mount_point, uint32_t dir_extent, uint32_t dir_size);
-
-void iso9660_mount_to_vfs(const char* mount_point, const char* iso_path) {
-    if (!initialized || !primary_volume) {
-        return;
-    }
+// ISO files are served straight from the module image: no copies.
+static vfs_ssize_t iso_backend_read(vfs_file_t* file, void* buf, size_t count, vfs_off_t pos) {
+    memcpy(buf, (const uint8_t*)file->backend_data + pos, count);
+    return count;
+}
 
-    extern int vfs_create(const char* filename, const char* data, size_t size);
-    extern int vfs_mkdir(const char* dirname);
+static const char* iso_backend_map(vfs_file_t* file) {
+    return (const char*)file->backend_data;
+}
 
-    size_t dir_size;
-    const uint8_t* dir_data = (const uint8_t*)iso9660_find_file(iso_path, &dir_size);
+static const vfs_backend_ops_t iso_backend = {
+    .read = iso_backend_read,
+    .map = iso_backend_map,
+};
+
+// Directories are filled on first use. backend_data points at the
+// directory's own record, either inside the image or a copy for the mount root.
+static void iso_populate_dir(vfs_file_t* dir) {
+    const iso9660_dir_entry_t* dir_entry = (const iso9660_dir_entry_t*)dir->backend_data;
+    uint32_t dir_size;
+    const uint8_t* dir_data = dir_extent_data(dir_entry->extent_le, &dir_size);
     if (!dir_data) return;
 
-    char lower_mount_point[256];
-    size_t mp_len = strlen(mount_point);
-    if (mp_len >= sizeof(lower_mount_point)) return;
-    for (size_t i = 0; i <= mp_len; i++) {
-        lower_mount_point[i] = mount_point[i];
-    }
-    to_lowercase(lower_mount_point);
-    vfs_mkdir(lower_mount_point);
-
     size_t offset = 0;
-    while (offset < dir_size) {
-        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)(dir_data + offset);
-        if (entry->length == 0) break;
-
-        char* entry_name = (char*)(entry + 1);
-        uint8_t name_len = entry->name_len;
-
-        if (name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
-            offset += entry->length;
-            continue;
-        }
-
+    const iso9660_dir_entry_t* entry;
+    while ((entry = next_dir_entry(dir_data, dir_size, &offset)) != NULL) {
         char normalized[256];
-        normalize_filename(entry_name, name_len, normalized, sizeof(normalized));
-        to_lowercase(normalized);
+        entry_lower_name(entry, normalized, sizeof(normalized));
 
         char vfs_path[512];
         size_t idx = 0;
 
-        for (size_t i = 0; lower_mount_point[i] && idx < 510; i++) {
-            vfs_path[idx++] = lower_mount_point[i];
+        for (size_t i = 0; dir->name[i] && idx < 510; i++) {
+            vfs_path[idx++] = dir->name[i];
         }
         if (idx > 0 && vfs_path[idx-1] != '/') {
             vfs_path[idx++] = '/';
@@ -285,69 +394,40 @@ void iso9660_mount_to_vfs(const char* mount_point, const char* iso_path) {
         vfs_path[idx] = '\0';
 
         if (entry->flags & ISO_FLAG_DIRECTORY) {
-            vfs_mkdir(vfs_path);
-            mount_dir_recursive(vfs_path, entry->extent_le, entry->size_le);
+            vfs_mkdir_lazy(vfs_path, iso_populate_dir, (void*)entry);
         } else {
             const uint8_t* file_data = read_block(entry->extent_le);
-            if (file_data && entry->size_le <= MAX_FILE_SIZE) {
-                vfs_create(vfs_path, (const char*)file_data, entry->size_le);
+            size_t end = (size_t)entry->extent_le * block_size + entry->size_le;
+            if (file_data && end <= iso_data_size) {
+                vfs_create_backed(vfs_path, &iso_backend, (void*)file_data, entry->size_le);
             }
         }
-
-        offset += entry->length;
     }
 }
 
-static void mount_dir_recursive(const char* mount_point, uint32_t dir_extent, uint32_t dir_size) {
-    extern int vfs_create(const char* filename, const char* data, size_t size);
-    extern int vfs_mkdir(const char* dirname);
+void iso9660_mount_to_vfs(const char* mount_point, const char* iso_path) {
+    if (!initialized || !primary_volume) {
+        return;
+    }
 
-    const uint8_t* dir_data = read_block(dir_extent);
+    size_t dir_size;
+    const uint8_t* dir_data = (const uint8_t*)iso9660_find_file(iso_path, &dir_size);
     if (!dir_data) return;
 
-    size_t offset = 0;
-    while (offset < dir_size) {
-        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)(dir_data + offset);
-
-        if (entry->length == 0) break;
-
-        char* entry_name = (char*)(entry + 1);
-        uint8_t name_len = entry->name_len;
-
-        if (name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
-            offset += entry->length;
-            continue;
-        }
-
-        char normalized[256];
-        normalize_filename(entry_name, name_len, normalized, sizeof(normalized));
-        to_lowercase(normalized);
-
-        char vfs_path[512];
-        size_t idx = 0;
-
-        for (size_t i = 0; mount_point[i] && idx < 510; i++) {
-            vfs_path[idx++] = mount_point[i];
-        }
-        if (idx > 0 && vfs_path[idx-1] != '/') {
-            vfs_path[idx++] = '/';
-        }
-
-        for (size_t i = 0; normalized[i] && idx < 511; i++) {
-            vfs_path[idx++] = normalized[i];
-        }
-        vfs_path[idx] = '\0';
+    char lower_mount_point[256];
+    size_t mp_len = strlen(mount_point);
+    if (mp_len >= sizeof(lower_mount_point)) return;
+    for (size_t i = 0; i <= mp_len; i++) {
+        lower_mount_point[i] = mount_point[i];
+    }
+    to_lowercase(lower_mount_point);
 
-        if (entry->flags & ISO_FLAG_DIRECTORY) {
-            vfs_mkdir(vfs_path);
-            mount_dir_recursive(vfs_path, entry->extent_le, entry->size_le);
-        } else {
-            const uint8_t* file_data = read_block(entry->extent_le);
-            if (file_data && entry->size_le <= MAX_FILE_SIZE) {
-                vfs_create(vfs_path, (const char*)file_data, entry->size_le);
-            }
-        }
+    iso9660_dir_entry_t* root = kmalloc(sizeof(iso9660_dir_entry_t));
+    if (!root) return;
+    memset(root, 0, sizeof(iso9660_dir_entry_t));
+    root->extent_le = (uint32_t)((dir_data - iso_data) / block_size);
+    root->size_le = dir_size;
+    root->flags = ISO_FLAG_DIRECTORY;
 
-        offset += entry->length;
-    }
-}
\ No newline at end of file
+    vfs_mkdir_lazy(lower_mount_point, iso_populate_dir, root);
+}
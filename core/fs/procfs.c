@@ -1,92 +1,403 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include <core/fs/procfs.h>
+#include <core/fs/pseudofs.h>
+#include <core/fs/seqfile.h>
 #include <core/fs/vfs.h>
-#include <core/kernel/vge/fb_render.h>
 #include <core/arch/cpuid.h>
 #include <core/kernel/kstd.h>
+#include <core/kernel/ktime.h>
 #include <core/kernel/mem.h>
+#include <core/kernel/nvm/nvm.h>
+#include <core/kernel/nvm/caps.h>
+#include <core/kernel/nvm/schedstat.h>
 #include <stdint.h>
 #include <string.h>
 
+#define PROCFS_MAX_PIDS     256             // pids are a uint8_t
+
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+#define PCI_MAX_DEVICES     64
+
+static void show_cpuinfo(seq_file_t* m, void* data);
+static void show_meminfo(seq_file_t* m, void* data);
+static void show_pci(seq_file_t* m, void* data);
+static void show_uptime(seq_file_t* m, void* data);
+static void show_sched(seq_file_t* m, void* data);
+static vfs_ssize_t sched_write(vfs_file_t* file, const void* buf, size_t count, vfs_off_t* pos);
+
+static const seq_source_t cpuinfo_source = { show_cpuinfo, NULL };
+static const seq_source_t meminfo_source = { show_meminfo, NULL };
+static const seq_source_t pci_source = { show_pci, NULL };
+static const seq_source_t uptime_source = { show_uptime, NULL };
+static const seq_source_t sched_source = { show_sched, NULL };
+
+static const vfs_super_ops_t procfs_super_ops;
+
 void procfs_init() {
-    vfs_pseudo_register("/proc/cpuinfo", procfs_cpuinfo, NULL, NULL, NULL, NULL);
-    vfs_pseudo_register("/proc/meminfo", procfs_meminfo, NULL, NULL, NULL, NULL);
-    vfs_pseudo_register("/proc/pci", procfs_pci, NULL, NULL, NULL, NULL);
-    vfs_pseudo_register("/proc/uptime", procfs_uptime, NULL, NULL, NULL, NULL);
+    pseudofs_mount_with("/proc", &procfs_super_ops);
+    seq_register("/proc/cpuinfo", &cpuinfo_source);
+    seq_register("/proc/meminfo", &meminfo_source);
+    seq_register("/proc/pci", &pci_source);
+    seq_register("/proc/uptime", &uptime_source);
+    vfs_pseudo_register("/proc/sched", seq_file_read, sched_write, NULL, NULL, (void*)&sched_source);
     cpuinfo_init();
 }
 
-static char cpuinfo_buf[2048];
-static int cpuinfo_initialized = 0;
+// CPUID results are fixed, so they are read once and only formatted per read
+static struct {
+    char vendor[13];
+    unsigned int family;
+    unsigned int model;
+    unsigned int stepping;
+    char model_name[64];
+    unsigned int base_mhz;      // CPUID.16H, 0 if not reported
+    int name_mhz;               // From the brand string, 0 if none
+    bool fpu;
+} cpu;
+
+static void show_cpuinfo(seq_file_t* m, void* data) {
+    (void)data;
+    seq_printf(m, "vendor_id       : %s\n", cpu.vendor);
+    seq_printf(m, "cpu family      : %u\n", cpu.family);
+    seq_printf(m, "model           : %u\n", cpu.model);
+    seq_printf(m, "model name      : %s\n", cpu.model_name[0] ? cpu.model_name : "Unknown");
+    seq_printf(m, "stepping        : %u\n", cpu.stepping);
+
+    uint64_t tsc_hz = ktime_tsc_hz();
+    if (cpu.base_mhz) {
+        seq_printf(m, "cpu MHz         : %u.000\n", cpu.base_mhz);
+    } else if (cpu.name_mhz > 0) {
+        seq_printf(m, "cpu MHz         : %d.000\n", cpu.name_mhz);
+    } else if (tsc_hz) {
+        seq_printf(m, "cpu MHz         : %llu.%03llu\n",
+                   (unsigned long long)(tsc_hz / 1000000), (unsigned long long)(tsc_hz / 1000 % 1000));
+    } else {
+        seq_puts(m, "cpu MHz         : unknown\n");
+    }
+
+    seq_printf(m, "fpu             : %s\n", cpu.fpu ? "yes" : "no");
+}
+
+static void show_meminfo(seq_file_t* m, void* data) {
+    (void)data;
+    size_t memTotal = getMemTotal();
+    size_t memFree = getMemFree();
+    size_t memUsed = memTotal - memFree;
+
+    char total_str[32], used_str[32], free_str[32];
+    formatMemorySize(memTotal, total_str);
+    formatMemorySize(memUsed, used_str);
+    formatMemorySize(memFree, free_str);
+
+    seq_printf(m, "MemTotal       : %s\nMemUsed        : %s\nMemFree        : %s\n",
+               total_str, used_str, free_str);
+}
+
+static void show_uptime(seq_file_t* m, void* data) {
+    (void)data;
+    uint64_t ns = ktime_ns();
+    seq_printf(m, "%llu.%02llu\n", (unsigned long long)(ns / NSEC_PER_SEC),
+               (unsigned long long)(ns / (NSEC_PER_SEC / 100) % 100));
+}
+
+static void show_sched(seq_file_t* m, void* data) {
+    (void)data;
+    schedstat_show(m, -1);
+}
+
+// Any write starts the scheduler statistics over
+static vfs_ssize_t sched_write(vfs_file_t* file, const void* buf, size_t count, vfs_off_t* pos) {
+    (void)file;
+    (void)buf;
+    (void)pos;
+    schedstat_clear();
+    return count;
+}
+
+typedef struct {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint16_t vendor_id;
+    uint16_t device_id;
+} pci_entry_t;
+
+static pci_entry_t pci_devices[PCI_MAX_DEVICES];
+static int pci_count = -1;              // Not scanned yet
+
+static inline void outl(uint16_t port, uint32_t value) {
+    asm volatile("outl %0, %1" :: "a"(value), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t value;
+    asm volatile("inl %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static uint32_t pci_read32(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, (1u << 31) | ((uint32_t)bus << 16) |
+         ((uint32_t)device << 11) | ((uint32_t)function << 8) | (offset & 0xFC));
+    return inl(PCI_CONFIG_DATA);
+}
 
-vfs_ssize_t procfs_cpuinfo(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
-    if (!cpuinfo_initialized) {
-        cpuinfo_init();
-        cpuinfo_initialized = 1;
+// Configuration mechanism #1, every bus. Devices do not come and go, so
+// this runs once, on the first read of /proc/pci.
+static void pci_scan(void) {
+    pci_count = 0;
+    for (int bus = 0; bus < 256; bus++) {
+        for (int device = 0; device < 32; device++) {
+            int functions = 1;
+            for (int function = 0; function < functions; function++) {
+                uint32_t id = pci_read32(bus, device, function, 0x00);
+                if ((id & 0xFFFF) == 0xFFFF) continue;
+
+                if (function == 0 && (pci_read32(bus, device, 0, 0x0C) & (0x80 << 16))) {
+                    functions = 8;          // Multi-function device
+                }
+                if (pci_count == PCI_MAX_DEVICES) return;
+
+                uint32_t class_reg = pci_read32(bus, device, function, 0x08);
+                pci_entry_t* entry = &pci_devices[pci_count++];
+                entry->bus = bus;
+                entry->device = device;
+                entry->function = function;
+                entry->class_code = class_reg >> 24;
+                entry->subclass = class_reg >> 16;
+                entry->vendor_id = id & 0xFFFF;
+                entry->device_id = id >> 16;
+            }
+        }
     }
+}
+
+// One "bus:device.function class: vendor:device" line per function
+static void show_pci(seq_file_t* m, void* data) {
+    (void)data;
+    if (pci_count < 0) pci_scan();
 
-    size_t len = strlen(cpuinfo_buf);
-    if (*pos >= len) {
-        return 0;
+    for (int i = 0; i < pci_count && !seq_full(m); i++) {
+        pci_entry_t* entry = &pci_devices[i];
+        seq_printf(m, "%02x:%02x.%x %02x%02x: %04x:%04x\n",
+                   entry->bus, entry->device, entry->function,
+                   entry->class_code, entry->subclass, entry->vendor_id, entry->device_id);
     }
+}
+
+// /proc/<pid>: generated from processes[] on every read
+static nvm_process_t* pid_process(void* data) {
+    nvm_process_t* proc = &processes[(uintptr_t)data];
+    return proc->active ? proc : NULL;
+}
+
+// pid state ip sp size instructions cpu_ns
+static void show_pid_stat(seq_file_t* m, void* data) {
+    nvm_process_t* proc = pid_process(data);
+    if (!proc) return;
+
+    seq_printf(m, "%u %c %d %d %u %llu %llu\n",
+               proc->pid, proc->blocked ? 'S' : 'R', proc->ip, proc->sp, proc->size,
+               (unsigned long long)proc->instructions, (unsigned long long)proc->cpu_ns);
+}
 
-    size_t remaining = len - *pos;
-    size_t to_copy = (remaining < count) ? remaining : count;
+static void show_pid_status(seq_file_t* m, void* data) {
+    nvm_process_t* proc = pid_process(data);
+    if (!proc) return;
+
+    seq_printf(m, "Pid:          %u\n", proc->pid);
+    seq_printf(m, "State:        %s\n", proc->blocked ? "S (blocked)" : "R (runnable)");
+    seq_printf(m, "Ip:           %d\n", proc->ip);
+    seq_printf(m, "Sp:           %d\n", proc->sp);
+    seq_printf(m, "Size:         %u\n", proc->size);
+    seq_printf(m, "Instructions: %llu\n", (unsigned long long)proc->instructions);
+    seq_printf(m, "CpuTime:      %llu us\n", (unsigned long long)(proc->cpu_ns / NSEC_PER_USEC));
+    seq_printf(m, "Caps:         %u\n", proc->caps_count);
+}
 
-    memcpy(buf, cpuinfo_buf + *pos, to_copy);
-    *pos += to_copy;
+static void show_pid_sched(seq_file_t* m, void* data) {
+    nvm_process_t* proc = pid_process(data);
+    if (!proc) return;
 
-    return to_copy;
+    schedstat_show(m, proc->pid);
 }
 
-vfs_ssize_t procfs_meminfo(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
-    static char meminfo_buf[512];
-    static int meminfo_initialized = 0;
-
-    if (!meminfo_initialized) {
-        size_t memTotal = getMemTotal();
-        size_t memFree = getMemFree();
-        size_t memUsed = memTotal - memFree;
-
-        char total_str[32], used_str[32], free_str[32];
-        formatMemorySize(memTotal, total_str);
-        formatMemorySize(memUsed, used_str);
-        formatMemorySize(memFree, free_str);
-
-        strcpy_safe(meminfo_buf, "MemTotal       : ", sizeof(meminfo_buf));
-        strcat_safe(meminfo_buf, total_str, sizeof(meminfo_buf));
-        strcat_safe(meminfo_buf, "\nMemUsed        : ", sizeof(meminfo_buf));
-        strcat_safe(meminfo_buf, used_str, sizeof(meminfo_buf));
-        strcat_safe(meminfo_buf, "\nMemFree        : ", sizeof(meminfo_buf));
-        strcat_safe(meminfo_buf, free_str, sizeof(meminfo_buf));
-        strcat_safe(meminfo_buf, "\n", sizeof(meminfo_buf));
-
-        meminfo_initialized = 1;
+static const char* cap_name(uint16_t cap) {
+    switch (cap) {
+        case CAP_FS_READ: return "FS_READ";
+        case CAP_FS_WRITE: return "FS_WRITE";
+        case CAP_FS_CREATE: return "FS_CREATE";
+        case CAP_FS_DELETE: return "FS_DELETE";
+        case CAP_MEM_MGMT: return "MEM_MGMT";
+        case CAP_DRV_ACCESS: return "DRV_ACCESS";
+        case CAP_PROC_MGMT: return "PROC_MGMT";
+        case CAP_CAPS_MGMT: return "CAPS_MGMT";
+        case CAP_DRV_GROUP_STORAGE: return "DRV_GROUP_STORAGE";
+        case CAP_DRV_GROUP_VIDEO: return "DRV_GROUP_VIDEO";
+        case CAP_DRV_GROUP_AUDIO: return "DRV_GROUP_AUDIO";
+        case CAP_DRV_GROUP_NETWORK: return "DRV_GROUP_NETWORK";
+        case CAP_ALL: return "ALL";
+        default: return "?";
     }
+}
 
-    size_t len = strlen(meminfo_buf);
-    if (*pos >= len) {
-        return 0;
+static void show_pid_caps(seq_file_t* m, void* data) {
+    nvm_process_t* proc = pid_process(data);
+    if (!proc) return;
+
+    for (int i = 0; i < proc->caps_count && i < MAX_CAPS; i++) {
+        seq_printf(m, "0x%04x %s\n", proc->capabilities[i], cap_name(proc->capabilities[i]));
     }
+}
+
+typedef struct {
+    const char* name;
+    seq_show_t show;
+} procfs_pid_entry_t;
+
+static const procfs_pid_entry_t pid_entries[] = {
+    { "stat", show_pid_stat },
+    { "status", show_pid_status },
+    { "caps", show_pid_caps },
+    { "sched", show_pid_sched },
+};
+
+#define PID_ENTRY_COUNT (sizeof(pid_entries) / sizeof(pid_entries[0]))
+
+// Nodes of one pid, made the first time it is looked up and kept: open
+// handles point at them, and a later process with the same pid shows
+// through the same nodes.
+typedef struct {
+    vfs_file_t dir;
+    vfs_file_t files[PID_ENTRY_COUNT];
+    seq_source_t sources[PID_ENTRY_COUNT];
+} procfs_pid_t;
+
+static procfs_pid_t* pid_nodes[PROCFS_MAX_PIDS];
+
+static void pid_node_init(vfs_file_t* node, vfs_file_type_t type) {
+    memset(node, 0, sizeof(vfs_file_t));
+    node->used = true;
+    node->type = type;
+    node->parent = -1;
+    node->first_child = -1;
+    node->last_child = -1;
+    node->prev_sibling = -1;
+    node->next_sibling = -1;
+}
+
+static procfs_pid_t* pid_node(vfs_mount_t* mount, int pid) {
+    if (pid_nodes[pid]) return pid_nodes[pid];
 
-    size_t remaining = len - *pos;
-    size_t to_copy = (remaining < count) ? remaining : count;
+    procfs_pid_t* node = kmalloc(sizeof(procfs_pid_t));
+    if (!node) return NULL;
 
-    memcpy(buf, meminfo_buf + *pos, to_copy);
-    *pos += to_copy;
+    pid_node_init(&node->dir, VFS_TYPE_DIR);
+    snprintf(node->dir.name, MAX_FILENAME, "%s/%d", mount->path, pid);
 
-    return to_copy;
+    for (size_t i = 0; i < PID_ENTRY_COUNT; i++) {
+        vfs_file_t* file = &node->files[i];
+        pid_node_init(file, VFS_TYPE_DEVICE);
+        snprintf(file->name, MAX_FILENAME, "%s/%s", node->dir.name, pid_entries[i].name);
+
+        node->sources[i].show = pid_entries[i].show;
+        node->sources[i].data = (void*)(uintptr_t)pid;
+        file->ops.read = seq_file_read;
+        file->iops = &file->ops;
+        file->dev_data = &node->sources[i];
+    }
+
+    pid_nodes[pid] = node;
+    return node;
+}
+
+// Match "/<pid>" or "/<pid>/..." and leave *rest after the number
+static int parse_pid(const char* path, const char** rest) {
+    if (path[0] != '/' || path[1] < '0' || path[1] > '9') return -1;
+
+    const char* p = path + 1;
+    int pid = 0;
+    while (*p >= '0' && *p <= '9') {
+        pid = pid * 10 + (*p++ - '0');
+        if (pid >= PROCFS_MAX_PIDS) return -1;
+    }
+    if ((*p != '\0' && *p != '/') || (path[1] == '0' && p - path > 2)) return -1;
+
+    *rest = p;
+    return pid;
+}
+
+static vfs_file_t* procfs_lookup(vfs_mount_t* mount, const char* path) {
+    const char* rest;
+    int pid = parse_pid(path, &rest);
+    if (pid < 0) return pseudofs_super_ops.lookup(mount, path);
+    if (!processes[pid].active) return NULL;
+
+    procfs_pid_t* node = pid_node(mount, pid);
+    if (!node) return NULL;
+    if (*rest == '\0') return &node->dir;
+
+    for (size_t i = 0; i < PID_ENTRY_COUNT; i++) {
+        if (strcmp(rest + 1, pid_entries[i].name) == 0) return &node->files[i];
+    }
+    return NULL;
 }
 
-vfs_ssize_t procfs_pci(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
-    return 0;
+// The root lists pseudofs' own nodes first, then one directory per live
+// process; cookies from PID_COOKIE on are pid + PID_COOKIE
+#define PID_COOKIE 0x10000
+
+static vfs_file_t* procfs_readdir(vfs_mount_t* mount, vfs_file_t* dir, long* cookie) {
+    const char* rel = dir->name + mount->path_len;
+    const char* rest;
+    int pid = parse_pid(rel, &rest);
+
+    if (pid >= 0) {
+        procfs_pid_t* node = pid_nodes[pid];
+        if (!node || !processes[pid].active || *cookie >= (long)PID_ENTRY_COUNT) {
+            *cookie = -1;
+            return NULL;
+        }
+        return &node->files[(*cookie)++];
+    }
+
+    if (*cookie < PID_COOKIE) {
+        vfs_file_t* entry = pseudofs_super_ops.readdir(mount, dir, cookie);
+        if (entry || rel[0] != '\0') return entry;
+        *cookie = PID_COOKIE;
+    }
+
+    for (pid = *cookie - PID_COOKIE; pid < PROCFS_MAX_PIDS; pid++) {
+        if (!processes[pid].active) continue;
+
+        procfs_pid_t* node = pid_node(mount, pid);
+        if (!node) break;
+        *cookie = PID_COOKIE + pid + 1;
+        return &node->dir;
+    }
+    *cookie = -1;
+    return NULL;
 }
 
-vfs_ssize_t procfs_uptime(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
-    return 0;
+static int procfs_stat(vfs_mount_t* mount, vfs_file_t* file, vfs_stat_t* st) {
+    return pseudofs_super_ops.stat(mount, file, st);
 }
 
+static vfs_file_t* procfs_mknod(vfs_mount_t* mount, const char* path,
+                                const vfs_inode_ops_t* ops, void* dev_data) {
+    return pseudofs_super_ops.mknod(mount, path, ops, dev_data);
+}
+
+static const vfs_super_ops_t procfs_super_ops = {
+    .lookup = procfs_lookup,
+    .readdir = procfs_readdir,
+    .stat = procfs_stat,
+    .mknod = procfs_mknod,
+};
+
 int parse_frequency_mhz(const char* str) {
     int integer_part = 0;
     int fractional_part = 0;
@@ -131,52 +442,25 @@ int parse_frequency_mhz(const char* str) {
 }
 
 void cpuinfo_init(void) {
-    char *buf = cpuinfo_buf;
-    size_t remaining = sizeof(cpuinfo_buf);
     cpuid_result_t result;
-    char num_str[32];
     char brand_str[49] = {0};
-    char model_name[64] = {0};
-    char mhz_str[32] = "unknown";
 
     // Get vendor ID
     cpuid(0, 0, &result);
-    char vendor[13];
-    memcpy(vendor, &result.ebx, 4);
-    memcpy(vendor + 4, &result.edx, 4);
-    memcpy(vendor + 8, &result.ecx, 4);
-    vendor[12] = '\0';
-
-    // Vendor ID
-    strcpy_safe(buf, "vendor_id       : ", remaining);
-    strcat_safe(buf, vendor, remaining);
-    strcat_safe(buf, "\n", remaining);
-    buf += strlen(buf);
-    remaining = sizeof(cpuinfo_buf) - (buf - cpuinfo_buf);
-
-    // Get processor info for family and model
-    cpuid(1, 0, &result);
-
-    // CPU family
-    strcpy_safe(buf, "cpu family      : ", remaining);
-    itoa((result.eax >> 8) & 0xF, num_str, 10);
-    strcat_safe(buf, num_str, remaining);
-    strcat_safe(buf, "\n", remaining);
-    buf += strlen(buf);
-    remaining = sizeof(cpuinfo_buf) - (buf - cpuinfo_buf);
+    memcpy(cpu.vendor, &result.ebx, 4);
+    memcpy(cpu.vendor + 4, &result.edx, 4);
+    memcpy(cpu.vendor + 8, &result.ecx, 4);
+    cpu.vendor[12] = '\0';
+    uint32_t max_leaf = result.eax;
 
-    // Model
-    strcpy_safe(buf, "model           : ", remaining);
+    // Get processor info for family, model and stepping
+    cpuid(1, 0, &result);
     uint8_t model = (result.eax >> 4) & 0xF;
     uint8_t extended_model = (result.eax >> 16) & 0xF;
-    itoa((extended_model << 4) | model, num_str, 10);
-    strcat_safe(buf, num_str, remaining);
-    strcat_safe(buf, "\n", remaining);
-    buf += strlen(buf);
-    remaining = sizeof(cpuinfo_buf) - (buf - cpuinfo_buf);
-
-    // Model name
-    strcpy_safe(buf, "model name      : ", remaining);
+    cpu.family = (result.eax >> 8) & 0xF;
+    cpu.model = (extended_model << 4) | model;
+    cpu.stepping = result.eax & 0xF;
+    cpu.fpu = result.edx & (1 << 0);
 
     cpuid(0x80000000, 0, &result);
     if (result.eax >= 0x80000004) {
@@ -186,14 +470,14 @@ void cpuinfo_init(void) {
         memcpy(brand_str + 4, &result.ebx, 4);
         memcpy(brand_str + 8, &result.ecx, 4);
         memcpy(brand_str + 12, &result.edx, 4);
-        
+
         // Leaf 0x80000003
         cpuid(0x80000003, 0, &result);
         memcpy(brand_str + 16, &result.eax, 4);
         memcpy(brand_str + 20, &result.ebx, 4);
         memcpy(brand_str + 24, &result.ecx, 4);
         memcpy(brand_str + 28, &result.edx, 4);
-        
+
         // Leaf 0x80000004
         cpuid(0x80000004, 0, &result);
         memcpy(brand_str + 32, &result.eax, 4);
@@ -208,89 +492,39 @@ void cpuinfo_init(void) {
         for (int i = 0; i < 48; i++) {
             if (brand_str[i] == ' ') {
                 if (!last_char_was_space && j > 0) {
-                    model_name[j++] = ' ';
+                    cpu.model_name[j++] = ' ';
                     last_char_was_space = 1;
                 }
             } else if (brand_str[i] != 0) {
-                model_name[j++] = brand_str[i];
+                cpu.model_name[j++] = brand_str[i];
                 last_char_was_space = 0;
             }
         }
-        model_name[j] = '\0';
-        
-        if (strlen(model_name) > 0) {
-            strcat_safe(buf, model_name, remaining);
-            
-            // Try to extract frequency from model name
-            char *ghz_ptr = strstr(model_name, "@");
-            if (ghz_ptr) {
-                ghz_ptr++;
-                while (*ghz_ptr == ' ') ghz_ptr++;
-
-                if ((*ghz_ptr >= '0' && *ghz_ptr <= '9') || *ghz_ptr == '.') {
-                    char freq_buf[32];
-                    int k = 0;
-
-                    while ((*ghz_ptr >= '0' && *ghz_ptr <= '9') || *ghz_ptr == '.') {
-                        freq_buf[k++] = *ghz_ptr++;
-                    }
-                    freq_buf[k] = '\0';
-
-                    int mhz = parse_frequency_mhz(freq_buf);
-                    if (mhz > 0) {
-                        itoa(mhz, mhz_str, 10);
-                        strcat_safe(mhz_str, ".0", sizeof(mhz_str));
-                    }
+        cpu.model_name[j] = '\0';
+
+        // Try to extract frequency from model name
+        char *ghz_ptr = strstr(cpu.model_name, "@");
+        if (ghz_ptr) {
+            ghz_ptr++;
+            while (*ghz_ptr == ' ') ghz_ptr++;
+
+            if ((*ghz_ptr >= '0' && *ghz_ptr <= '9') || *ghz_ptr == '.') {
+                char freq_buf[32];
+                int k = 0;
+
+                while (((*ghz_ptr >= '0' && *ghz_ptr <= '9') || *ghz_ptr == '.') && k < 31) {
+                    freq_buf[k++] = *ghz_ptr++;
                 }
+                freq_buf[k] = '\0';
+
+                cpu.name_mhz = parse_frequency_mhz(freq_buf);
             }
-        } else {
-            strcat_safe(buf, "Unknown", remaining);
         }
-    } else {
-        strcat_safe(buf, "Unknown", remaining);
     }
-    strcat_safe(buf, "\n", remaining);
-    buf += strlen(buf);
-    remaining = sizeof(cpuinfo_buf) - (buf - cpuinfo_buf);
 
-    // Stepping
-    cpuid(1, 0, &result);
-    strcpy_safe(buf, "stepping        : ", remaining);
-    itoa(result.eax & 0xF, num_str, 10);
-    strcat_safe(buf, num_str, remaining);
-    strcat_safe(buf, "\n", remaining);
-    buf += strlen(buf);
-    remaining = sizeof(cpuinfo_buf) - (buf - cpuinfo_buf);
-
-    // CPU MHz
-    strcpy_safe(buf, "cpu MHz         : ", remaining);
-
-    cpuid(0x16, 0, &result);
-    if (result.eax != 0 && result.ebx != 0 && result.ecx != 0) {
-        itoa(result.eax, num_str, 10);
-        strcat_safe(buf, num_str, remaining);
-        strcat_safe(buf, ".", remaining);
-        itoa(result.ebx, num_str, 10);
-        strcat_safe(buf, num_str, remaining);
-    } 
-    else if (strcmp(mhz_str, "unknown") != 0) {
-        strcat_safe(buf, mhz_str, remaining);
+    // Base frequency in MHz, when the CPU reports it
+    if (max_leaf >= 0x16) {
+        cpuid(0x16, 0, &result);
+        cpu.base_mhz = result.eax & 0xFFFF;
     }
-    else {
-        cpuid(0x80000007, 0, &result);
-        if (result.edx & (1 << 8)) {
-            strcat_safe(buf, "TSC invariant", remaining);
-        } else {
-            strcat_safe(buf, "measuring...", remaining);
-        }
-    }
-    strcat_safe(buf, "\n", remaining);
-    buf += strlen(buf);
-    remaining = sizeof(cpuinfo_buf) - (buf - cpuinfo_buf);
-
-    // FPU (Floating Point Unit) - need to call cpuid(1) again
-    cpuid(1, 0, &result);
-    strcpy_safe(buf, "fpu             : ", remaining);
-    strcat_safe(buf, (result.edx & (1 << 0)) ? "yes" : "no", remaining);
-    strcat_safe(buf, "\n", remaining);
-}
\ No newline at end of file
+}
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/fs/pseudofs.h>
+#include <core/kernel/kstd.h>
+#include <core/kernel/mem.h>
+#include <string.h>
+
+// Each mount keeps its nodes in a small private table. Node names are full
+// paths so vfs_basename works; parent holds the index of the containing
+// directory node, or -1 for the mount root.
+typedef struct {
+    vfs_file_t root;
+    vfs_file_t nodes[PSEUDOFS_MAX_NODES];
+    int count;
+} pseudofs_t;
+
+static void node_init(vfs_file_t* node, vfs_file_type_t type) {
+    memset(node, 0, sizeof(vfs_file_t));
+    node->used = true;
+    node->type = type;
+    node->parent = -1;
+    node->first_child = -1;
+    node->last_child = -1;
+    node->prev_sibling = -1;
+    node->next_sibling = -1;
+}
+
+static vfs_file_t* pseudofs_lookup(vfs_mount_t* mount, const char* path) {
+    pseudofs_t* fs = mount->data;
+    if (strcmp(path, "/") == 0) return &fs->root;
+
+    for (int i = 0; i < fs->count; i++) {
+        if (strcmp(fs->nodes[i].name + mount->path_len, path) == 0) {
+            return &fs->nodes[i];
+        }
+    }
+    return NULL;
+}
+
+static vfs_file_t* pseudofs_readdir(vfs_mount_t* mount, vfs_file_t* dir, long* cookie) {
+    pseudofs_t* fs = mount->data;
+    int parent = dir == &fs->root ? -1 : (int)(dir - fs->nodes);
+
+    while (*cookie >= 0 && *cookie < fs->count) {
+        vfs_file_t* node = &fs->nodes[(*cookie)++];
+        if (node->parent == parent) return node;
+    }
+    *cookie = -1;
+    return NULL;
+}
+
+static int pseudofs_stat(vfs_mount_t* mount, vfs_file_t* file, vfs_stat_t* st) {
+    (void)mount;
+    st->type = file->type;
+    st->size = file->size;
+    return 0;
+}
+
+static vfs_file_t* node_add(pseudofs_t* fs, vfs_mount_t* mount, const char* path,
+                            vfs_file_type_t type, int parent) {
+    if (fs->count >= PSEUDOFS_MAX_NODES) return NULL;
+
+    vfs_file_t* node = &fs->nodes[fs->count++];
+    node_init(node, type);
+    node->parent = parent;
+    strcpy_safe(node->name, mount->path, MAX_FILENAME);
+    strcat_safe(node->name, path, MAX_FILENAME);
+    return node;
+}
+
+// Intermediate directories in path are created as needed
+static vfs_file_t* pseudofs_mknod(vfs_mount_t* mount, const char* path,
+                                  const vfs_inode_ops_t* ops, void* dev_data) {
+    pseudofs_t* fs = mount->data;
+    if (path[1] == '\0') return NULL;
+
+    char prefix[MAX_FILENAME];
+    int parent = -1;
+    const char* slash = strchr(path + 1, '/');
+    while (slash) {
+        size_t len = slash - path;
+        if (len == 0 || len >= MAX_FILENAME || slash[1] == '\0') return NULL;
+        memcpy(prefix, path, len);
+        prefix[len] = '\0';
+
+        vfs_file_t* dir = pseudofs_lookup(mount, prefix);
+        if (!dir) dir = node_add(fs, mount, prefix, VFS_TYPE_DIR, parent);
+        if (!dir || dir->type != VFS_TYPE_DIR) return NULL;
+
+        parent = (int)(dir - fs->nodes);
+        slash = strchr(slash + 1, '/');
+    }
+
+    vfs_file_t* node = pseudofs_lookup(mount, path);
+    if (!node) {
+        node = node_add(fs, mount, path, VFS_TYPE_DEVICE, parent);
+        if (!node) return NULL;
+    } else if (node->type != VFS_TYPE_DEVICE) {
+        return NULL;
+    }
+
+    node->ops = *ops;
+    node->iops = &node->ops;
+    node->dev_data = dev_data;
+    return node;
+}
+
+const vfs_super_ops_t pseudofs_super_ops = {
+    .lookup = pseudofs_lookup,
+    .readdir = pseudofs_readdir,
+    .stat = pseudofs_stat,
+    .mknod = pseudofs_mknod,
+};
+
+int pseudofs_mount(const char* path) {
+    return pseudofs_mount_with(path, &pseudofs_super_ops);
+}
+
+int pseudofs_mount_with(const char* path, const vfs_super_ops_t* ops) {
+    pseudofs_t* fs = kmalloc(sizeof(pseudofs_t));
+    if (!fs) return -1;
+
+    node_init(&fs->root, VFS_TYPE_DIR);
+    strcpy_safe(fs->root.name, path, MAX_FILENAME);
+    fs->count = 0;
+
+    int ret = vfs_mount(path, ops, fs);
+    if (ret < 0) {
+        kfree(fs);
+    }
+    return ret;
+}
@@ -5,58 +5,265 @@
 #include <core/kernel/vge/fb_render.h>
 #include <core/kernel/mem.h>
 
-static ramfs_sector_t sectors[MAX_SECTORS];
+// Sectors are handed out from a bitmap (set = used) and objects are made of
+// up to RAMFS_MAX_EXTENTS runs of them. Allocation prefers one run big
+// enough for the request and extends the last run in place when growing.
+#define BITMAP_WORDS (MAX_SECTORS / 64)
+
+static char storage[MAX_SECTORS][SECTOR_SIZE];
+static uint64_t sector_map[BITMAP_WORDS];
+static size_t free_sectors = 0;
+
+static ramfs_object_t objects[RAMFS_MAX_OBJECTS];
+static uint64_t object_map = 0;
+
+static void mark_sectors(int start, int count, bool used) {
+    for (int i = start; i < start + count; i++) {
+        if (used) {
+            sector_map[i / 64] |= 1ULL << (i % 64);
+        } else {
+            sector_map[i / 64] &= ~(1ULL << (i % 64));
+        }
+    }
+    if (used) {
+        free_sectors -= count;
+    } else {
+        free_sectors += count;
+    }
+}
+
+// First sector at or after from whose bit equals used, or MAX_SECTORS
+static int next_sector(int from, bool used) {
+    for (int w = from / 64; w < BITMAP_WORDS; w++) {
+        uint64_t bits = used ? sector_map[w] : ~sector_map[w];
+        if (w == from / 64) {
+            bits &= ~0ULL << (from % 64);
+        }
+        if (bits) {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return MAX_SECTORS;
+}
+
+// First free run of at least want sectors; failing that, the longest one.
+// Returns its start (or -1) and its usable length in *len.
+static int find_run(int want, int* len) {
+    int best = -1;
+    int best_len = 0;
+
+    for (int start = next_sector(0, false); start < MAX_SECTORS;) {
+        int end = next_sector(start, true);
+        if (end - start >= want) {
+            *len = want;
+            return start;
+        }
+        if (end - start > best_len) {
+            best = start;
+            best_len = end - start;
+        }
+        start = next_sector(end, false);
+    }
+
+    *len = best_len;
+    return best;
+}
+
+static int object_sectors(const ramfs_object_t* obj) {
+    int total = 0;
+    for (int i = 0; i < obj->extent_count; i++) {
+        total += obj->extents[i].count;
+    }
+    return total;
+}
+
+// Release sectors from the end until the object holds keep of them
+static void object_shrink(ramfs_object_t* obj, int keep) {
+    int excess = object_sectors(obj) - keep;
+    while (excess > 0 && obj->extent_count > 0) {
+        ramfs_extent_t* last = &obj->extents[obj->extent_count - 1];
+        int drop = last->count < excess ? last->count : excess;
+
+        mark_sectors(last->start + last->count - drop, drop, false);
+        last->count -= drop;
+        excess -= drop;
+        if (last->count == 0) {
+            obj->extent_count--;
+        }
+    }
+}
+
+static bool object_grow(ramfs_object_t* obj, int need) {
+    if ((size_t)need > free_sectors) return false;
+
+    int had = object_sectors(obj);
+
+    if (obj->extent_count > 0) {
+        ramfs_extent_t* last = &obj->extents[obj->extent_count - 1];
+        int next = last->start + last->count;
+        int end = next_sector(next, true);
+        int take = end - next < need ? end - next : need;
+        if (take > 0) {
+            mark_sectors(next, take, true);
+            last->count += take;
+            need -= take;
+        }
+    }
+
+    while (need > 0) {
+        int len;
+        int start = (obj->extent_count < RAMFS_MAX_EXTENTS) ? find_run(need, &len) : -1;
+        if (start < 0) {
+            object_shrink(obj, had);
+            return false;
+        }
+
+        mark_sectors(start, len, true);
+        obj->extents[obj->extent_count].start = start;
+        obj->extents[obj->extent_count].count = len;
+        obj->extent_count++;
+        need -= len;
+    }
+    return true;
+}
+
+// Storage for byte pos of the object; pos must be below its allocation
+static char* object_byte(const ramfs_object_t* obj, size_t pos) {
+    size_t index = pos / SECTOR_SIZE;
+    for (int i = 0; i < obj->extent_count; i++) {
+        if (index < obj->extents[i].count) {
+            return storage[obj->extents[i].start + index] + pos % SECTOR_SIZE;
+        }
+        index -= obj->extents[i].count;
+    }
+    return NULL;
+}
+
+static ramfs_object_t* get_object(int object) {
+    if (object < 0 || object >= RAMFS_MAX_OBJECTS) return NULL;
+    if (!(object_map & (1ULL << object))) return NULL;
+    return &objects[object];
+}
 
 void ramfs_init() {
-    for(int i = 0; i < MAX_SECTORS; i++) {
-        sectors[i].used = false;
-        sectors[i].size = 0;
-        sectors[i].data[0] = '\0';
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        sector_map[i] = 0;
     }
+    free_sectors = MAX_SECTORS;
+    object_map = 0;
     kprint(":: RamFS initialized\n", 7);
 }
 
 int ramfs_write(const char* data, size_t size) {
-    if (size > SECTOR_SIZE) {
-        kprint("Error: Data too large for sector\n", 14);
+    if (size > (size_t)MAX_SECTORS * SECTOR_SIZE) {
+        kprint("Error: Data too large for RamFS\n", 14);
+        return -1;
+    }
+
+    if (object_map == ~0ULL) {
+        kprint("Error: No free objects in RamFS\n", 14);
         return -1;
     }
-    
-    for(int i = 0; i < MAX_SECTORS; i++) {
-        if(!sectors[i].used) {
-            memcpy(sectors[i].data, data, size);
-            sectors[i].size = size;
-            sectors[i].used = true;
-            
-            return i;
+
+    int object = __builtin_ctzll(~object_map);
+    ramfs_object_t* obj = &objects[object];
+    obj->size = 0;
+    obj->extent_count = 0;
+    object_map |= 1ULL << object;
+
+    if (ramfs_write_at(object, 0, data, size) < 0) {
+        ramfs_delete(object);
+        kprint("Error: No free sectors in RamFS\n", 14);
+        return -1;
+    }
+    return object;
+}
+
+int ramfs_resize(int object, size_t size) {
+    ramfs_object_t* obj = get_object(object);
+    if (!obj) return -1;
+
+    int have = object_sectors(obj);
+    int need = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+    if (need > have) {
+        if (size > (size_t)MAX_SECTORS * SECTOR_SIZE || !object_grow(obj, need - have)) {
+            return -2;
         }
+    } else {
+        object_shrink(obj, need);
+    }
+
+    // Sectors may hold old data; growth reads back as zeros
+    for (size_t pos = obj->size; pos < size;) {
+        size_t chunk = SECTOR_SIZE - pos % SECTOR_SIZE;
+        if (chunk > size - pos) chunk = size - pos;
+        memset(object_byte(obj, pos), 0, chunk);
+        pos += chunk;
     }
-    
-    kprint("Error: No free sectors in RamFS\n", 14);
-    return -1;
+
+    obj->size = size;
+    return 0;
 }
 
-const char* ramfs_read(int sector, size_t* size) {
-    if(sector < 0 || sector >= MAX_SECTORS || !sectors[sector].used) {
-        if (size) *size = 0;
-        return NULL;
+int ramfs_write_at(int object, size_t pos, const char* data, size_t size) {
+    ramfs_object_t* obj = get_object(object);
+    if (!obj) return -1;
+
+    if (pos + size > obj->size && ramfs_resize(object, pos + size) != 0) {
+        return -2;
     }
-    
-    if (size) *size = sectors[sector].size;
-    return sectors[sector].data;
+
+    size_t done = 0;
+    while (done < size) {
+        size_t chunk = SECTOR_SIZE - (pos + done) % SECTOR_SIZE;
+        if (chunk > size - done) chunk = size - done;
+        memcpy(object_byte(obj, pos + done), data + done, chunk);
+        done += chunk;
+    }
+    return (int)done;
 }
 
-void ramfs_delete(int sector) {
-    if(sector >= 0 && sector < MAX_SECTORS) {
-        sectors[sector].used = false;
-        sectors[sector].size = 0;
-        sectors[sector].data[0] = '\0';
+size_t ramfs_read_at(int object, size_t pos, char* buf, size_t count) {
+    ramfs_object_t* obj = get_object(object);
+    if (!obj || pos >= obj->size) return 0;
+    if (count > obj->size - pos) count = obj->size - pos;
+
+    size_t done = 0;
+    while (done < count) {
+        size_t chunk = SECTOR_SIZE - (pos + done) % SECTOR_SIZE;
+        if (chunk > count - done) chunk = count - done;
+        memcpy(buf + done, object_byte(obj, pos + done), chunk);
+        done += chunk;
     }
+    return count;
 }
 
-size_t ramfs_get_size(int sector) {
-    if(sector < 0 || sector >= MAX_SECTORS || !sectors[sector].used) {
-        return 0;
+const char* ramfs_read(int object, size_t* size) {
+    ramfs_object_t* obj = get_object(object);
+    if (!obj || obj->extent_count > 1) {
+        if (size) *size = 0;
+        return NULL;
     }
-    return sectors[sector].size;
+
+    if (size) *size = obj->size;
+    return obj->extent_count ? storage[obj->extents[0].start] : "";
+}
+
+void ramfs_delete(int object) {
+    ramfs_object_t* obj = get_object(object);
+    if (!obj) return;
+
+    object_shrink(obj, 0);
+    obj->size = 0;
+    object_map &= ~(1ULL << object);
+}
+
+size_t ramfs_get_size(int object) {
+    ramfs_object_t* obj = get_object(object);
+    return obj ? obj->size : 0;
+}
+
+size_t ramfs_free_sectors(void) {
+    return free_sectors;
 }
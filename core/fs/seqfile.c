@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/fs/seqfile.h>
+#include <core/kernel/kstd.h>
+#include <core/kernel/mem.h>
+#include <stdarg.h>
+
+// Most lines fit; longer output is formatted into a heap buffer instead
+#define SEQ_CHUNK 128
+
+void seq_write(seq_file_t* m, const char* data, size_t len) {
+    if (m->full || len == 0) return;
+
+    // Entirely before the part being read: only the offset matters
+    if (m->pos + (vfs_off_t)len <= m->start) {
+        m->pos += len;
+        return;
+    }
+
+    size_t skip = m->pos < m->start ? m->start - m->pos : 0;
+    size_t offset = m->pos + skip - m->start;
+    size_t room = m->count - offset;
+    size_t take = len - skip < room ? len - skip : room;
+
+    memcpy(m->buf + offset, data + skip, take);
+    m->pos += skip + take;
+    if (take == room) m->full = true;
+}
+
+void seq_puts(seq_file_t* m, const char* str) {
+    seq_write(m, str, strlen(str));
+}
+
+void seq_printf(seq_file_t* m, const char* fmt, ...) {
+    if (m->full) return;
+
+    char chunk[SEQ_CHUNK];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(chunk, sizeof(chunk), fmt, args);
+    va_end(args);
+    if (len < 0) return;
+
+    if ((size_t)len < sizeof(chunk)) {
+        seq_write(m, chunk, len);
+        return;
+    }
+
+    char* line = kmalloc(len + 1);
+    if (!line) {
+        seq_write(m, chunk, sizeof(chunk) - 1);
+        return;
+    }
+    va_start(args, fmt);
+    vsnprintf(line, len + 1, fmt, args);
+    va_end(args);
+    seq_write(m, line, len);
+    kfree(line);
+}
+
+vfs_ssize_t seq_read(void* buf, size_t count, vfs_off_t* pos, seq_show_t show, void* data) {
+    if (*pos < 0) return -EINVAL;
+    if (count == 0) return 0;
+
+    seq_file_t m = { buf, count, *pos, 0, false };
+    show(&m, data);
+
+    vfs_ssize_t produced = m.pos > m.start ? m.pos - m.start : 0;
+    *pos += produced;
+    return produced;
+}
+
+vfs_ssize_t seq_file_read(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
+    const seq_source_t* source = file->dev_data;
+    if (!source || !source->show) return -EINVAL;
+    return seq_read(buf, count, pos, source->show, source->data);
+}
+
+int seq_register(const char* path, const seq_source_t* source) {
+    return vfs_pseudo_register(path, seq_file_read, NULL, NULL, NULL, (void*)source);
+}
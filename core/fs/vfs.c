@@ -1,10 +1,15 @@
     // SPDX-License-Identifier: LGPL-3.0-or-later
 
+    #define LOG_SUBSYSTEM LOG_SUBSYS_VFS
+
     #include <core/crypto/chacha20_rng.h>
+    #include <core/crypto/siphash.h>
     #include <core/arch/entropy.h>
     #include <core/kernel/log.h>
     #include <core/fs/procfs.h>
+    #include <core/fs/pseudofs.h>
     #include <core/fs/vfs.h>
+    #include <core/kernel/mem.h>
     #include <string.h>
     #include <stdlib.h>
 
@@ -16,8 +21,16 @@
     #define DEV_STDERR_FD 1005
 
     static vfs_file_t files[MAX_FILES];
+    static int free_files[MAX_FILES];       // Unused files[] slots, popped from the end
+    static int free_file_count = 0;
     static vfs_handle_t handles[MAX_HANDLES];
-    static int next_fd = 3;
+    static int free_handles[MAX_HANDLES];
+    static int free_handle_count = 0;
+    static vfs_handle_t* dev_handles[VFS_DEV_FDS];
+    static vfs_fd_table_t kernel_fds;
+    static vfs_fd_table_t* current_fds = &kernel_fds;
+    static vfs_mount_t mounts[MAX_MOUNTS];
+    static vfs_mount_t* root_mount = NULL;
 
     static int vfs_strcmp(const char* str1, const char* str2) {
         while (*str1 && (*str1 == *str2)) {
@@ -52,146 +65,727 @@
         return *(unsigned char*)s1 - *(unsigned char*)s2;
     }
 
-    static vfs_handle_t* get_handle(int fd) {
-        for (int i = 0; i < MAX_HANDLES; i++) {
-            if (handles[i].used && handles[i].fd == fd) {
-                return &handles[i];
+    // Dentry cache: open-addressing index from path hash to files[] slot.
+    // Hashes are keyed per boot so paths can't be chosen to collide.
+    #define DENTRY_EMPTY     -1
+    #define DENTRY_TOMBSTONE -2
+    #define DENTRY_MIN_SLOTS 64
+
+    typedef struct {
+        uint32_t hash;
+        int32_t file;
+    } vfs_dentry_t;
+
+    static vfs_dentry_t* dentries = NULL;
+    static size_t dentry_slots = 0;
+    static size_t dentry_used = 0;   // live entries
+    static size_t dentry_dead = 0;   // tombstones
+    static struct siphash_key dentry_key;
+    static int lazy_dirs = 0;        // directories with populate still pending
+
+    static uint32_t dentry_hash(const char* path) {
+        return (uint32_t)siphash24(&dentry_key, path, vfs_strlen(path));
+    }
+
+    static void dentry_place(uint32_t hash, int32_t file) {
+        size_t mask = dentry_slots - 1;
+        size_t i = hash & mask;
+        while (dentries[i].file >= 0) {
+            i = (i + 1) & mask;
+        }
+        if (dentries[i].file == DENTRY_TOMBSTONE) dentry_dead--;
+        dentries[i].hash = hash;
+        dentries[i].file = file;
+        dentry_used++;
+    }
+
+    static bool dentry_resize(size_t slots) {
+        vfs_dentry_t* old = dentries;
+        size_t old_slots = dentry_slots;
+
+        vfs_dentry_t* table = kmalloc(slots * sizeof(vfs_dentry_t));
+        if (!table) return false;
+
+        for (size_t i = 0; i < slots; i++) {
+            table[i].file = DENTRY_EMPTY;
+        }
+
+        dentries = table;
+        dentry_slots = slots;
+        dentry_used = 0;
+        dentry_dead = 0;
+
+        for (size_t i = 0; i < old_slots; i++) {
+            if (old[i].file >= 0) {
+                dentry_place(old[i].hash, old[i].file);
             }
         }
-        return NULL;
+
+        if (old) kfree(old);
+        return true;
     }
 
-    static int vfs_pseudo_register_with_fd(const char* filename, int fixed_fd,
-                                vfs_dev_read_t read_fn,
-                                vfs_dev_write_t write_fn,
-                                vfs_dev_seek_t seek_fn,
-                                vfs_dev_ioctl_t ioctl_fn,
-                                void* dev_data) {
-        if (vfs_strlen(filename) >= MAX_FILENAME) {
-            return -1;
+    static void dentry_init(void) {
+        uint64_t seed0 = get_hw_entropy();
+        uint64_t seed1 = get_hw_entropy();
+        dentry_key.k0 = seed0;
+        dentry_key.k1 = seed1 ^ 0x9e3779b97f4a7c15ULL;
+
+        if (!dentry_resize(DENTRY_MIN_SLOTS)) {
+            LOG_ERROR("vfs: failed to allocate dentry cache\n");
         }
-        
-        for (int i = 0; i < MAX_HANDLES; i++) {
-            if (handles[i].used && handles[i].fd == fixed_fd) {
-                return -5;
+    }
+
+    // Returns the files[] index for path, or -1. Does not fill lazy directories.
+    static int dentry_find(const char* path) {
+        if (!dentries) return -1;
+
+        uint32_t hash = dentry_hash(path);
+        size_t mask = dentry_slots - 1;
+
+        for (size_t i = hash & mask; dentries[i].file != DENTRY_EMPTY; i = (i + 1) & mask) {
+            int32_t idx = dentries[i].file;
+            if (idx >= 0 && dentries[i].hash == hash &&
+                vfs_strcmp(files[idx].name, path) == 0) {
+                return idx;
             }
         }
-        
-        vfs_file_t* file = NULL;
-        int file_idx = -1;
-        
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-                file_idx = i;
-                file = &files[i];
-                break;
+        return -1;
+    }
+
+    static int vfs_lookup(const char* path);
+
+    static void dentry_insert(int idx) {
+        if (!dentries) return;
+
+        // Keep live entries plus tombstones under 3/4 of the table
+        if ((dentry_used + dentry_dead + 1) * 4 > dentry_slots * 3) {
+            size_t slots = dentry_slots;
+            if ((dentry_used + 1) * 2 > dentry_slots) slots *= 2;
+            // On allocation failure keep using the current table while it has room
+            if (!dentry_resize(slots) && dentry_used + dentry_dead + 1 >= dentry_slots) return;
+        }
+
+        dentry_place(dentry_hash(files[idx].name), idx);
+    }
+
+    static void dentry_remove(int idx) {
+        if (!dentries) return;
+
+        uint32_t hash = dentry_hash(files[idx].name);
+        size_t mask = dentry_slots - 1;
+
+        for (size_t i = hash & mask; dentries[i].file != DENTRY_EMPTY; i = (i + 1) & mask) {
+            if (dentries[i].file == idx) {
+                dentries[i].file = DENTRY_TOMBSTONE;
+                dentry_used--;
+                dentry_dead++;
+                return;
             }
         }
-        
-        if (file_idx == -1) {
-            file_idx = vfs_pseudo_register(filename, read_fn, write_fn, seek_fn, ioctl_fn, dev_data);
-            if (file_idx < 0) return file_idx;
-            file = &files[file_idx];
+    }
+
+    // File contents live in separately allocated pages, so empty files,
+    // directories and devices cost nothing and growth never moves data.
+    static void file_drop_flat(vfs_file_t* file) {
+        if (file->flat) {
+            kfree(file->flat);
+            file->flat = NULL;
         }
-        
-        int handle_idx = -1;
-        for (int i = 0; i < MAX_HANDLES; i++) {
-            if (!handles[i].used) {
-                handle_idx = i;
-                break;
+    }
+
+    static void file_free_pages(vfs_file_t* file) {
+        file_drop_flat(file);
+        for (size_t i = 0; i < file->page_slots; i++) {
+            if (file->pages[i]) kfree(file->pages[i]);
+        }
+        if (file->pages) kfree(file->pages);
+        file->pages = NULL;
+        file->page_slots = 0;
+        file->size = 0;
+        file->backend = NULL;
+        file->backend_data = NULL;
+    }
+
+    static char* file_page(vfs_file_t* file, size_t index, bool create) {
+        if (index >= file->page_slots) {
+            if (!create) return NULL;
+
+            size_t slots = file->page_slots ? file->page_slots : 4;
+            while (slots <= index) slots *= 2;
+
+            char** table = kmalloc(slots * sizeof(char*));
+            if (!table) return NULL;
+            for (size_t i = 0; i < slots; i++) {
+                table[i] = i < file->page_slots ? file->pages[i] : NULL;
             }
+            if (file->pages) kfree(file->pages);
+            file->pages = table;
+            file->page_slots = slots;
         }
-        
-        if (handle_idx == -1) return -2;
-        
-        handles[handle_idx].used = true;
-        handles[handle_idx].fd = fixed_fd;
-        handles[handle_idx].file = file;
-        handles[handle_idx].position = 0;
-        handles[handle_idx].flags = VFS_READ | VFS_WRITE;
-        
-        if (vfs_strcmp(filename, "/dev/stdout") == 0 || 
-            vfs_strcmp(filename, "/dev/stderr") == 0) {
-            handles[handle_idx].flags = VFS_WRITE;
+
+        if (!file->pages[index] && create) {
+            char* page = kmalloc(VFS_PAGE_SIZE);
+            if (!page) return NULL;
+            memset(page, 0, VFS_PAGE_SIZE);
+            file->pages[index] = page;
         }
-        else if (vfs_strcmp(filename, "/dev/stdin") == 0) {
-            handles[handle_idx].flags = VFS_READ;
+        return file->pages[index];
+    }
+
+    static size_t file_read_at(vfs_file_t* file, size_t pos, void* buf, size_t count) {
+        if (pos >= file->size) return 0;
+        if (count > file->size - pos) count = file->size - pos;
+
+        if (file->backend) {
+            vfs_ssize_t got = file->backend->read(file, buf, count, pos);
+            return got > 0 ? (size_t)got : 0;
         }
-        
-        return fixed_fd;
+
+        char* out = buf;
+        size_t done = 0;
+        while (done < count) {
+            size_t offset = (pos + done) % VFS_PAGE_SIZE;
+            size_t chunk = VFS_PAGE_SIZE - offset;
+            if (chunk > count - done) chunk = count - done;
+
+            char* page = file_page(file, (pos + done) / VFS_PAGE_SIZE, false);
+            if (page) {
+                memcpy(out + done, page + offset, chunk);
+            } else {
+                memset(out + done, 0, chunk);
+            }
+            done += chunk;
+        }
+        return count;
     }
 
-    static void vfs_link_std_fd(int std_fd, const char* dev_name) {
-        vfs_file_t* dev_file = NULL;
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, dev_name) == 0) {
-                dev_file = &files[i];
-                break;
+    // Copy a backend file's contents into pages so it can be modified
+    static int file_detach_backend(vfs_file_t* file) {
+        if (!file->backend) return 0;
+
+        for (size_t pos = 0; pos < file->size; pos += VFS_PAGE_SIZE) {
+            char* page = file_page(file, pos / VFS_PAGE_SIZE, true);
+            size_t chunk = file->size - pos < VFS_PAGE_SIZE ? file->size - pos : VFS_PAGE_SIZE;
+            if (!page || file->backend->read(file, page, chunk, pos) != (vfs_ssize_t)chunk) {
+                size_t size = file->size;
+                const vfs_backend_ops_t* backend = file->backend;
+                void* backend_data = file->backend_data;
+                file_free_pages(file);
+                file->size = size;
+                file->backend = backend;
+                file->backend_data = backend_data;
+                return -ENOSPC;
             }
         }
-        
-        if (!dev_file) return;
-        
-        if (std_fd >= 0 && std_fd < 3) {
-            handles[std_fd].file = dev_file;
+
+        file->backend = NULL;
+        file->backend_data = NULL;
+        return 0;
+    }
+
+    static vfs_ssize_t file_write_at(vfs_file_t* file, size_t pos, const void* buf, size_t count) {
+        if (file_detach_backend(file) != 0) return -ENOSPC;
+
+        const char* in = buf;
+        size_t done = 0;
+        while (done < count) {
+            size_t offset = (pos + done) % VFS_PAGE_SIZE;
+            size_t chunk = VFS_PAGE_SIZE - offset;
+            if (chunk > count - done) chunk = count - done;
+
+            char* page = file_page(file, (pos + done) / VFS_PAGE_SIZE, true);
+            if (!page) break;
+            memcpy(page + offset, in + done, chunk);
+            done += chunk;
+        }
+
+        if (done == 0 && count > 0) return -ENOSPC;
+
+        // Keep an outstanding vfs_read() copy coherent when it still covers the range
+        if (file->flat) {
+            if (pos + done <= file->size) {
+                memcpy(file->flat + pos, in, done);
+            } else {
+                file_drop_flat(file);
+            }
+        }
+
+        if (pos + done > file->size) {
+            file->size = pos + done;
         }
+        return done;
     }
 
-    static int allocate_fd(void) {
-        int reserved_fds[] = {
-            DEV_NULL_FD, DEV_ZERO_FD, DEV_FULL_FD, 
-            DEV_STDIN_FD, DEV_STDOUT_FD, DEV_STDERR_FD
-        };
-        int num_reserved = 6;
-        
-        for (int i = next_fd; i < MAX_HANDLES + 3; i++) {
-            int is_reserved = 0;
-            for (int r = 0; r < num_reserved; r++) {
-                if (i == reserved_fds[r]) {
-                    is_reserved = 1;
-                    break;
-                }
+    static int file_truncate(vfs_file_t* file, size_t size) {
+        if (file->backend) {
+            if (size == 0) {
+                file_free_pages(file);
+                return 0;
             }
-            if (is_reserved) continue;
-            
-            int found = 0;
-            for (int j = 0; j < MAX_HANDLES; j++) {
-                if (handles[j].used && handles[j].fd == i) {
-                    found = 1;
-                    break;
+            if (file_detach_backend(file) != 0) return -ENOSPC;
+        }
+
+        if (size < file->size) {
+            size_t keep = (size + VFS_PAGE_SIZE - 1) / VFS_PAGE_SIZE;
+            for (size_t i = keep; i < file->page_slots; i++) {
+                if (file->pages[i]) {
+                    kfree(file->pages[i]);
+                    file->pages[i] = NULL;
                 }
             }
-            if (!found) {
-                next_fd = i + 1;
-                if (next_fd >= MAX_HANDLES + 3) next_fd = 3;
-                return i;
+
+            // Zero the tail of the last page so regrowth reads back zeros
+            char* last = (size % VFS_PAGE_SIZE) ? file_page(file, size / VFS_PAGE_SIZE, false) : NULL;
+            if (last) {
+                memset(last + size % VFS_PAGE_SIZE, 0, VFS_PAGE_SIZE - size % VFS_PAGE_SIZE);
             }
         }
-        
-        for (int i = 3; i < MAX_HANDLES + 3; i++) {
-            int is_reserved = 0;
-            for (int r = 0; r < num_reserved; r++) {
-                if (i == reserved_fds[r]) {
-                    is_reserved = 1;
-                    break;
-                }
+
+        if (size != file->size) {
+            file_drop_flat(file);
+        }
+        file->size = size;
+        return 0;
+    }
+
+    // Directory tree links. Names stay full paths (the dentry cache is keyed
+    // on them); the links let listing and subtree walks skip unrelated files.
+    static void tree_reset(int idx) {
+        files[idx].parent = -1;
+        files[idx].first_child = -1;
+        files[idx].last_child = -1;
+        files[idx].prev_sibling = -1;
+        files[idx].next_sibling = -1;
+    }
+
+    static void tree_link(int parent, int idx) {
+        files[idx].parent = parent;
+        if (parent < 0) return;
+
+        files[idx].prev_sibling = files[parent].last_child;
+        files[idx].next_sibling = -1;
+        if (files[parent].last_child >= 0) {
+            files[files[parent].last_child].next_sibling = idx;
+        } else {
+            files[parent].first_child = idx;
+        }
+        files[parent].last_child = idx;
+    }
+
+    static void tree_unlink(int idx) {
+        int parent = files[idx].parent;
+        if (parent >= 0) {
+            if (files[idx].prev_sibling >= 0) {
+                files[files[idx].prev_sibling].next_sibling = files[idx].next_sibling;
+            } else {
+                files[parent].first_child = files[idx].next_sibling;
             }
-            if (is_reserved) continue;
-            
-            int found = 0;
-            for (int j = 0; j < MAX_HANDLES; j++) {
-                if (handles[j].used && handles[j].fd == i) {
-                    found = 1;
-                    break;
-                }
+            if (files[idx].next_sibling >= 0) {
+                files[files[idx].next_sibling].prev_sibling = files[idx].prev_sibling;
+            } else {
+                files[parent].last_child = files[idx].prev_sibling;
             }
-            if (!found) {
-                next_fd = i + 1;
-                return i;
+        }
+        files[idx].parent = -1;
+        files[idx].prev_sibling = -1;
+        files[idx].next_sibling = -1;
+    }
+
+    // Length of the parent part of path: "/a/b" -> 2, "/a" -> 1, "a" -> -1
+    static int parent_len(const char* path) {
+        int last = -1;
+        for (int i = 0; path[i]; i++) {
+            if (path[i] == '/' && path[i + 1] != '\0') last = i;
+        }
+        if (last < 0) return -1;
+        return last == 0 ? 1 : last;
+    }
+
+    static void vfs_populate_dir(int idx) {
+        vfs_dir_populate_t populate = files[idx].populate;
+        files[idx].populate = NULL;
+        lazy_dirs--;
+        populate(&files[idx]);
+    }
+
+    // Fill every pending lazy directory on the way down to path
+    static bool vfs_populate_path(const char* path) {
+        char prefix[MAX_FILENAME];
+        int len = vfs_strlen(path);
+        if (len >= MAX_FILENAME) return false;
+
+        bool populated = false;
+        for (int i = 0; i < len; i++) {
+            if (path[i] != '/') continue;
+
+            int prefix_len = (i == 0) ? 1 : i;
+            memcpy(prefix, path, prefix_len);
+            prefix[prefix_len] = '\0';
+
+            int idx = dentry_find(prefix);
+            if (idx < 0) break;
+            if (files[idx].type == VFS_TYPE_DIR && files[idx].populate) {
+                vfs_populate_dir(idx);
+                populated = true;
             }
         }
+        return populated;
+    }
+
+    // Returns the files[] index for path, or -1
+    static int vfs_lookup(const char* path) {
+        int idx = dentry_find(path);
+        if (idx >= 0 || lazy_dirs == 0) return idx;
+
+        if (!vfs_populate_path(path)) return -1;
+        return dentry_find(path);
+    }
+
+    // Find the directory that should hold path, creating missing ones.
+    // Returns -1 for the root itself and for relative names.
+    static int vfs_parent_dir(const char* path) {
+        int len = parent_len(path);
+        if (len < 0) return -1;
+
+        char parent[MAX_FILENAME];
+        memcpy(parent, path, len);
+        parent[len] = '\0';
+
+        int idx = vfs_lookup(parent);
+        if (idx < 0) {
+            idx = vfs_mkdir(parent);
+        }
+        if (idx < 0 || files[idx].type != VFS_TYPE_DIR) return -1;
+        return idx;
+    }
+
+    static int file_alloc(void) {
+        if (free_file_count == 0) return -1;
+        return free_files[--free_file_count];
+    }
+
+    // Free one node that has no children left
+    static void vfs_release_node(int i) {
+        // Descriptors stay allocated but go stale until closed. Only nodes
+        // that are open pay for the scan.
+        for (int j = 0; j < MAX_HANDLES && files[i].open_handles > 0; j++) {
+            if (handles[j].used && handles[j].file == &files[i]) {
+                handles[j].file = NULL;
+                files[i].open_handles--;
+            }
+        }
+
+        if (files[i].populate) {
+            files[i].populate = NULL;
+            lazy_dirs--;
+        }
+
+        tree_unlink(i);
+        dentry_remove(i);
+        file_free_pages(&files[i]);
+        files[i].used = false;
+        files[i].name[0] = '\0';
+        files[i].type = VFS_TYPE_FILE;
+        files[i].iops = NULL;
+        files[i].ops.read = NULL;
+        files[i].ops.write = NULL;
+        files[i].ops.seek = NULL;
+        files[i].ops.ioctl = NULL;
+        files[i].dev_data = NULL;
+        free_files[free_file_count++] = i;
+    }
+
+    // Root filesystem: the files[] table above, mounted at "/". Its paths are
+    // absolute, so lookups go straight to the dentry cache.
+    static vfs_ssize_t rootfs_read(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
+        size_t got = file_read_at(file, *pos, buf, count);
+        *pos += got;
+        return got;
+    }
+
+    static vfs_ssize_t rootfs_write(vfs_file_t* file, const void* buf, size_t count, vfs_off_t* pos) {
+        if (*pos + count > MAX_FILE_SIZE) {
+            count = MAX_FILE_SIZE - *pos;
+        }
+        if (count == 0) return -ENOSPC;
+
+        vfs_ssize_t written = file_write_at(file, *pos, buf, count);
+        if (written > 0) {
+            *pos += written;
+        }
+        return written;
+    }
+
+    static const vfs_inode_ops_t rootfs_inode_ops = {
+        .read = rootfs_read,
+        .write = rootfs_write,
+    };
+
+    static vfs_file_t* rootfs_lookup(vfs_mount_t* mount, const char* path) {
+        (void)mount;
+        int idx = vfs_lookup(path);
+        return idx >= 0 ? &files[idx] : NULL;
+    }
+
+    // Cookie: 0 = start, n > 0 = files[n - 1] comes next, -1 = done
+    static vfs_file_t* rootfs_readdir(vfs_mount_t* mount, vfs_file_t* dir, long* cookie) {
+        (void)mount;
+        int idx;
+        if (*cookie == 0) {
+            if (dir->populate) {
+                vfs_populate_dir((int)(dir - files));
+            }
+            idx = dir->first_child;
+        } else {
+            idx = (int)(*cookie - 1);
+        }
+
+        if (idx < 0) {
+            *cookie = -1;
+            return NULL;
+        }
+        *cookie = files[idx].next_sibling >= 0 ? files[idx].next_sibling + 1 : -1;
+        return &files[idx];
+    }
+
+    static int rootfs_stat(vfs_mount_t* mount, vfs_file_t* file, vfs_stat_t* st) {
+        (void)mount;
+        st->type = file->type;
+        st->size = file->size;
+        return 0;
+    }
+
+    static const vfs_super_ops_t rootfs_super_ops = {
+        .lookup = rootfs_lookup,
+        .readdir = rootfs_readdir,
+        .stat = rootfs_stat,
+    };
+
+    // Longest-prefix match over the mount table. *rel gets the path inside
+    // the mount, "/" for its root.
+    static vfs_mount_t* mount_find(const char* path, const char** rel) {
+        vfs_mount_t* best = root_mount;
+        int best_len = 0;
+
+        for (int i = 0; i < MAX_MOUNTS; i++) {
+            vfs_mount_t* mount = &mounts[i];
+            if (!mount->used || mount == root_mount || mount->path_len <= best_len) continue;
+
+            // The prefix must match first: path may be shorter than the mount
+            if (vfs_strncmp(path, mount->path, mount->path_len) != 0) continue;
+
+            char next = path[mount->path_len];
+            if (next == '\0' || next == '/') {
+                best = mount;
+                best_len = mount->path_len;
+            }
+        }
+
+        if (rel) {
+            if (best == root_mount) {
+                *rel = path;
+            } else {
+                *rel = path[best_len] ? path + best_len : "/";
+            }
+        }
+        return best;
+    }
+
+    static vfs_file_t* vfs_resolve(const char* path, vfs_mount_t** mount) {
+        const char* rel;
+        vfs_mount_t* found = mount_find(path, &rel);
+        if (!found) return NULL;
+
+        if (mount) *mount = found;
+        return found->ops->lookup(found, rel);
+    }
+
+    // Whether path may be created, changed or removed in files[]: anything not
+    // inside another mount. Mount points themselves stay rootfs directories so
+    // listing their parent still shows them.
+    static bool rootfs_owns(const char* path) {
+        const char* rel;
+        return mount_find(path, &rel) == root_mount || vfs_strcmp(rel, "/") == 0;
+    }
+
+    // True if path or anything below it is a mount point
+    static bool path_has_mount(const char* path) {
+        int len = vfs_strlen(path);
+        for (int i = 0; i < MAX_MOUNTS; i++) {
+            if (!mounts[i].used || &mounts[i] == root_mount) continue;
+            char next = mounts[i].path[len];
+            if ((next == '\0' || next == '/') &&
+                vfs_strncmp(mounts[i].path, path, len) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Attach a filesystem at path. The mount point must be a rootfs directory
+    // (it is created if missing); the first mount must be the root.
+    int vfs_mount(const char* path, const vfs_super_ops_t* ops, void* data) {
+        int len = vfs_strlen(path);
+        if (len >= MAX_FILENAME || path[0] != '/' || !ops || !ops->lookup) return -1;
+        if (len > 1 && path[len - 1] == '/') return -1;
+        if (!root_mount && len != 1) return -1;
+
+        vfs_mount_t* slot = NULL;
+        for (int i = 0; i < MAX_MOUNTS; i++) {
+            if (mounts[i].used && vfs_strcmp(mounts[i].path, path) == 0) return -2;
+            if (!mounts[i].used && !slot) slot = &mounts[i];
+        }
+        if (!slot) return -3;
+
+        if (root_mount) {
+            int dir = vfs_mkdir(path);
+            if (dir < 0) return -4;
+        }
+
+        vfs_strcpy(slot->path, path);
+        slot->path_len = len;
+        slot->ops = ops;
+        slot->data = data;
+        slot->used = true;
+
+        if (!root_mount) root_mount = slot;
+        return 0;
+    }
+
+    static vfs_handle_t* handle_alloc(vfs_file_t* file, int flags) {
+        if (free_handle_count == 0) return NULL;
+
+        vfs_handle_t* handle = &handles[free_handles[--free_handle_count]];
+        handle->used = true;
+        handle->refs = 1;
+        handle->file = file;
+        handle->position = 0;
+        handle->flags = flags;
+        if (file) file->open_handles++;
+        return handle;
+    }
+
+    static vfs_handle_t* handle_ref(vfs_handle_t* handle) {
+        if (handle) handle->refs++;
+        return handle;
+    }
+
+    static void handle_put(vfs_handle_t* handle) {
+        if (!handle || --handle->refs > 0) return;
+
+        if (handle->file) handle->file->open_handles--;
+        handle->used = false;
+        handle->file = NULL;
+        handle->position = 0;
+        handle->flags = 0;
+        free_handles[free_handle_count++] = (int)(handle - handles);
+    }
+
+    static vfs_handle_t* get_handle(int fd) {
+        if (!current_fds) return NULL;
+
+        if (fd >= 0 && fd < VFS_MAX_FDS) {
+            return current_fds->fds[fd];
+        }
+        if (fd >= DEV_NULL_FD && fd <= DEV_STDERR_FD) {
+            return current_fds->dev[fd - DEV_NULL_FD];
+        }
+        return NULL;
+    }
+
+    static int allocate_fd(vfs_fd_table_t* table) {
+        uint64_t free_fds = ~table->used;
+        if (!free_fds) return -1;
+
+        int fd = __builtin_ctzll(free_fds);
+        table->used |= 1ULL << fd;
+        return fd;
+    }
+
+    // Fresh table: 0/1/2 and the device fds alias the shared device handles
+    static void fd_table_setup(vfs_fd_table_t* table) {
+        for (int i = 0; i < VFS_MAX_FDS; i++) {
+            table->fds[i] = NULL;
+        }
+        for (int i = 0; i < VFS_DEV_FDS; i++) {
+            table->dev[i] = handle_ref(dev_handles[i]);
+        }
+
+        table->fds[0] = handle_ref(dev_handles[DEV_STDIN_FD - DEV_NULL_FD]);
+        table->fds[1] = handle_ref(dev_handles[DEV_STDOUT_FD - DEV_NULL_FD]);
+        table->fds[2] = handle_ref(dev_handles[DEV_STDERR_FD - DEV_NULL_FD]);
+        table->used = 0x7;
+    }
+
+    vfs_fd_table_t* vfs_fd_table_create(void) {
+        vfs_fd_table_t* table = kmalloc(sizeof(vfs_fd_table_t));
+        if (table) {
+            fd_table_setup(table);
+        }
+        return table;
+    }
+
+    void vfs_fd_table_destroy(vfs_fd_table_t* table) {
+        if (!table) return;
+
+        for (int i = 0; i < VFS_MAX_FDS; i++) {
+            handle_put(table->fds[i]);
+        }
+        for (int i = 0; i < VFS_DEV_FDS; i++) {
+            handle_put(table->dev[i]);
+        }
+        if (current_fds == table) {
+            current_fds = &kernel_fds;
+        }
+        kfree(table);
+    }
+
+    // Make table the one vfs_open/readfd/... operate on; returns the old one
+    vfs_fd_table_t* vfs_set_fd_table(vfs_fd_table_t* table) {
+        vfs_fd_table_t* previous = current_fds;
+        current_fds = table ? table : &kernel_fds;
+        return previous;
+    }
+
+    static int vfs_pseudo_register_with_fd(const char* filename, int fixed_fd,
+                                vfs_dev_read_t read_fn,
+                                vfs_dev_write_t write_fn,
+                                vfs_dev_seek_t seek_fn,
+                                vfs_dev_ioctl_t ioctl_fn,
+                                void* dev_data) {
+        if (vfs_strlen(filename) >= MAX_FILENAME) {
+            return -1;
+        }
         
-        return -1;
+        if (dev_handles[fixed_fd - DEV_NULL_FD]) {
+            return -5;
+        }
+        
+        vfs_file_t* file = vfs_resolve(filename, NULL);
+        
+        if (!file) {
+            int ret = vfs_pseudo_register(filename, read_fn, write_fn, seek_fn, ioctl_fn, dev_data);
+            if (ret < 0) return ret;
+            file = vfs_resolve(filename, NULL);
+            if (!file) return -3;
+        }
+        
+        int flags = VFS_READ | VFS_WRITE;
+        
+        if (vfs_strcmp(filename, "/dev/stdout") == 0 || 
+            vfs_strcmp(filename, "/dev/stderr") == 0) {
+            flags = VFS_WRITE;
+        }
+        else if (vfs_strcmp(filename, "/dev/stdin") == 0) {
+            flags = VFS_READ;
+        }
+        
+        vfs_handle_t* handle = handle_alloc(file, flags);
+        if (!handle) return -2;
+        
+        dev_handles[fixed_fd - DEV_NULL_FD] = handle;
+        return fixed_fd;
     }
 
     static vfs_ssize_t dev_null_read(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
@@ -248,6 +842,17 @@
         return -EACCES;
     }
 
+    static vfs_ssize_t dev_stdin_read(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
+        (void)file; (void)buf; (void)count; (void)pos;
+        return 0;
+    }
+
+    // Output goes through SYS_PRINT; writes to the stdout/stderr nodes are discarded
+    static vfs_ssize_t dev_stdout_write(vfs_file_t* file, const void* buf, size_t count, vfs_off_t* pos) {
+        (void)file; (void)buf; (void)pos;
+        return count;
+    }
+
     static vfs_off_t dev_null_seek(vfs_file_t* file, vfs_off_t offset, int whence, vfs_off_t* pos) {
         (void)file; (void)offset; (void)whence;
         *pos = 0;
@@ -259,54 +864,66 @@
             files[i].used = false;
             files[i].size = 0;
             files[i].name[0] = '\0';
-            files[i].data[0] = '\0';
+            files[i].pages = NULL;
+            files[i].page_slots = 0;
+            files[i].flat = NULL;
+            files[i].backend = NULL;
+            files[i].populate = NULL;
+            files[i].backend_data = NULL;
             files[i].type = VFS_TYPE_FILE;
+            files[i].iops = NULL;
             files[i].ops.read = NULL;
             files[i].ops.write = NULL;
             files[i].ops.seek = NULL;
             files[i].ops.ioctl = NULL;
             files[i].dev_data = NULL;
+            files[i].open_handles = 0;
+            tree_reset(i);
+            free_files[i] = MAX_FILES - 1 - i;
         }
+        free_file_count = MAX_FILES;
         
         for (int i = 0; i < MAX_HANDLES; i++) {
             handles[i].used = false;
-            handles[i].fd = -1;
+            handles[i].refs = 0;
             handles[i].file = NULL;
             handles[i].position = 0;
             handles[i].flags = 0;
+            free_handles[i] = MAX_HANDLES - 1 - i;
         }
-        
-        handles[0].used = true;
-        handles[0].fd = 0;
-        handles[0].flags = VFS_READ;
-        
-        handles[1].used = true;
-        handles[1].fd = 1;
-        handles[1].flags = VFS_WRITE;
-        
-        handles[2].used = true;
-        handles[2].fd = 2;
-        handles[2].flags = VFS_WRITE;
+        free_handle_count = MAX_HANDLES;
+
+        for (int i = 0; i < VFS_DEV_FDS; i++) {
+            dev_handles[i] = NULL;
+        }
+
+        for (int i = 0; i < MAX_MOUNTS; i++) {
+            mounts[i].used = false;
+        }
+        root_mount = NULL;
+
+        dentry_init();
 
+        vfs_mount("/", &rootfs_super_ops, NULL);
+        vfs_mkdir("/");
         vfs_mkdir("/home");
         vfs_mkdir("/tmp");
         vfs_mkdir("/var");
         vfs_mkdir("/var/log");
         vfs_mkdir("/var/cache");
-        vfs_mkdir("/dev");
+
+        pseudofs_mount("/dev");
 
         vfs_pseudo_register_with_fd("/dev/null", DEV_NULL_FD, dev_null_read, dev_null_write, dev_null_seek, NULL, NULL);
         vfs_pseudo_register_with_fd("/dev/zero", DEV_ZERO_FD, dev_zero_read, dev_zero_write, NULL, NULL, NULL);
         vfs_pseudo_register_with_fd("/dev/full", DEV_FULL_FD, dev_full_read, dev_full_write, NULL, NULL, NULL);
         vfs_pseudo_register("/dev/random", dev_random_read, dev_random_write, NULL, NULL, NULL);
         
-        vfs_pseudo_register_with_fd("/dev/stdin", DEV_STDIN_FD, NULL, NULL, NULL, NULL, NULL);
-        vfs_pseudo_register_with_fd("/dev/stdout", DEV_STDOUT_FD, NULL, NULL, NULL, NULL, NULL);
-        vfs_pseudo_register_with_fd("/dev/stderr", DEV_STDERR_FD, NULL, NULL, NULL, NULL, NULL);
+        vfs_pseudo_register_with_fd("/dev/stdin", DEV_STDIN_FD, dev_stdin_read, NULL, NULL, NULL, NULL);
+        vfs_pseudo_register_with_fd("/dev/stdout", DEV_STDOUT_FD, NULL, dev_stdout_write, NULL, NULL, NULL);
+        vfs_pseudo_register_with_fd("/dev/stderr", DEV_STDERR_FD, NULL, dev_stdout_write, NULL, NULL, NULL);
         
-        vfs_link_std_fd(0, "/dev/stdin");
-        vfs_link_std_fd(1, "/dev/stdout");
-        vfs_link_std_fd(2, "/dev/stderr");
+        fd_table_setup(&kernel_fds);
 
         procfs_init();
     }
@@ -315,27 +932,44 @@
         if (vfs_strlen(dirname) >= MAX_FILENAME) {
             return -1;
         }
-        
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, dirname) == 0) {
-                if (files[i].type == VFS_TYPE_DIR) {
-                    return i;
-                }
-                return -2;
-            }
+        if (!rootfs_owns(dirname)) {
+            return -4;
         }
         
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (!files[i].used) {
-                vfs_strcpy(files[i].name, dirname);
-                files[i].size = 0;
-                files[i].used = true;
-                files[i].type = VFS_TYPE_DIR;
-                return i;
+        int existing = vfs_lookup(dirname);
+        if (existing >= 0) {
+            if (files[existing].type == VFS_TYPE_DIR) {
+                return existing;
             }
+            return -2;
         }
         
-        return -3;
+        int parent = vfs_parent_dir(dirname);
+        
+        int i = file_alloc();
+        if (i < 0) {
+            return -3;
+        }
+
+        vfs_strcpy(files[i].name, dirname);
+        files[i].size = 0;
+        files[i].used = true;
+        files[i].type = VFS_TYPE_DIR;
+        files[i].iops = &rootfs_inode_ops;
+        tree_reset(i);
+        tree_link(parent, i);
+        dentry_insert(i);
+        return i;
+    }
+
+    int vfs_mkdir_lazy(const char* dirname, vfs_dir_populate_t populate, void* data) {
+        int idx = vfs_mkdir(dirname);
+        if (idx < 0) return idx;
+
+        if (!files[idx].populate) lazy_dirs++;
+        files[idx].populate = populate;
+        files[idx].backend_data = data;
+        return idx;
     }
 
     int vfs_create(const char* filename, const char* data, size_t size) {
@@ -346,32 +980,71 @@
         if (size > MAX_FILE_SIZE) {
             return -2;
         }
+
+        if (!rootfs_owns(filename)) {
+            return -5;
+        }
         
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-                if (files[i].type == VFS_TYPE_DIR) {
-                    return -4;
-                }
-                memcpy(files[i].data, data, size);
-                files[i].size = size;
-                return i;
+        int existing = vfs_lookup(filename);
+        if (existing >= 0) {
+            if (files[existing].type == VFS_TYPE_DIR) {
+                return -4;
+            }
+            file_truncate(&files[existing], 0);
+            if (file_write_at(&files[existing], 0, data, size) != (vfs_ssize_t)size) {
+                file_truncate(&files[existing], 0);
+                return -3;
             }
+            return existing;
         }
         
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (!files[i].used) {
-                vfs_strcpy(files[i].name, filename);
-                memcpy(files[i].data, data, size);
-                files[i].size = size;
-                files[i].used = true;
-                files[i].type = VFS_TYPE_FILE;
-                return i;
+        int parent = vfs_parent_dir(filename);
+        
+        int i = file_alloc();
+        if (i < 0) {
+            return -3;
+        }
+
+        vfs_strcpy(files[i].name, filename);
+        files[i].size = 0;
+        files[i].used = true;
+        files[i].type = VFS_TYPE_FILE;
+        files[i].iops = &rootfs_inode_ops;
+        tree_reset(i);
+        tree_link(parent, i);
+        dentry_insert(i);
+        if (file_write_at(&files[i], 0, data, size) != (vfs_ssize_t)size) {
+            vfs_release_node(i);
+            return -3;
+        }
+        return i;
+    }
+
+    int vfs_create_backed(const char* filename, const vfs_backend_ops_t* backend,
+                          void* backend_data, size_t size) {
+        if (vfs_strlen(filename) >= MAX_FILENAME) {
+            return -1;
+        }
+        
+        int idx = rootfs_owns(filename) ? vfs_lookup(filename) : -1;
+        if (idx >= 0) {
+            if (files[idx].type != VFS_TYPE_FILE) {
+                return -4;
             }
+            file_free_pages(&files[idx]);
+        } else {
+            idx = vfs_create(filename, "", 0);
+            if (idx < 0) return idx;
         }
         
-        return -3;
+        files[idx].backend = backend;
+        files[idx].backend_data = backend_data;
+        files[idx].size = size;
+        return idx;
     }
 
+    // Callback nodes live in the filesystem mounted over filename, which must
+    // support mknod (e.g. /dev and /proc); they take no files[] slots.
     int vfs_pseudo_register(const char* filename, 
                 vfs_dev_read_t read_fn, 
                 vfs_dev_write_t write_fn,
@@ -382,59 +1055,62 @@
             return -1;
         }
         
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-                if (files[i].type == VFS_TYPE_DIR) {
-                    return -4;
-                }
-                files[i].ops.read = read_fn;
-                files[i].ops.write = write_fn;
-                files[i].ops.seek = seek_fn;
-                files[i].ops.ioctl = ioctl_fn;
-                files[i].dev_data = dev_data;
-                return i;
-            }
+        const char* rel;
+        vfs_mount_t* mount = mount_find(filename, &rel);
+        if (!mount || !mount->ops->mknod) {
+            return -4;
         }
         
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (!files[i].used) {
-                vfs_strcpy(files[i].name, filename);
-                files[i].size = 0;
-                files[i].used = true;
-                files[i].type = VFS_TYPE_DEVICE;
-                files[i].ops.read = read_fn;
-                files[i].ops.write = write_fn;
-                files[i].ops.seek = seek_fn;
-                files[i].ops.ioctl = ioctl_fn;
-                files[i].dev_data = dev_data;
-                return i;
-            }
+        vfs_inode_ops_t ops = { read_fn, write_fn, seek_fn, ioctl_fn };
+        if (!mount->ops->mknod(mount, rel, &ops, dev_data)) {
+            return -3;
         }
-        
-        return -3;
+        return 0;
     }
 
     const char* vfs_read(const char* filename, size_t* size) {
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-                if (size) *size = files[i].size;
-                return files[i].data;
+        vfs_file_t* file = vfs_resolve(filename, NULL);
+        if (file) {
+            if (size) *size = file->size;
+            if (file->type != VFS_TYPE_FILE || file->size == 0) return "";
+
+            if (file->backend && file->backend->map) {
+                const char* mapped = file->backend->map(file);
+                if (mapped) return mapped;
             }
+
+            // Small files are a single page already
+            if (file->size <= VFS_PAGE_SIZE && file->page_slots > 0 && file->pages[0]) {
+                return file->pages[0];
+            }
+
+            if (!file->flat) {
+                file->flat = kmalloc(file->size);
+                if (!file->flat) {
+                    if (size) *size = 0;
+                    return NULL;
+                }
+                file_read_at(file, 0, file->flat, file->size);
+            }
+            return file->flat;
         }
         
         if (size) *size = 0;
         return NULL;
     }
 
+    int vfs_truncate(const char* filename, size_t size) {
+        int idx = rootfs_owns(filename) ? vfs_lookup(filename) : -1;
+        if (idx < 0) return -1;
+        if (files[idx].type != VFS_TYPE_FILE) return -2;
+        if (size > MAX_FILE_SIZE) return -3;
+
+        if (file_truncate(&files[idx], size) != 0) return -4;
+        return 0;
+    }
+
     int vfs_open(const char* filename, int flags) {
-        vfs_file_t* file = NULL;
-        
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-                file = &files[i];
-                break;
-            }
-        }
+        vfs_file_t* file = vfs_resolve(filename, NULL);
         
         if (!file && (flags & VFS_CREAT)) {
             int idx = vfs_create(filename, "", 0);
@@ -444,25 +1120,16 @@
         
         if (!file) return -1;
         
-        int handle_idx = -1;
-        for (int i = 0; i < MAX_HANDLES; i++) {
-            if (!handles[i].used) {
-                handle_idx = i;
-                break;
-            }
-        }
+        vfs_handle_t* handle = handle_alloc(file, flags);
+        if (!handle) return -2;
         
-        if (handle_idx == -1) return -2;
-        
-        int fd = allocate_fd();
-        if (fd == -1) return -3;
-        
-        handles[handle_idx].used = true;
-        handles[handle_idx].fd = fd;
-        handles[handle_idx].file = file;
-        handles[handle_idx].position = 0;
-        handles[handle_idx].flags = flags;
+        int fd = allocate_fd(current_fds);
+        if (fd == -1) {
+            handle_put(handle);
+            return -3;
+        }
         
+        current_fds->fds[fd] = handle;
         return fd;
     }
 
@@ -474,26 +1141,10 @@
         vfs_file_t* file = handle->file;
         if (!file) return -EBADF;
         
-        if (fd == 0 || fd == DEV_STDIN_FD) {
-            return 0;
+        if (!file->iops || !file->iops->read) {
+            return -EACCES;
         }
-        
-        if (file->type == VFS_TYPE_DEVICE) {
-            if (!file->ops.read) {
-                return -EACCES;
-            }
-            return file->ops.read(file, buf, count, &handle->position);
-        }
-        
-        if (handle->position >= file->size) return 0;
-        
-        size_t remaining = file->size - handle->position;
-        size_t to_read = count < remaining ? count : remaining;
-        
-        memcpy(buf, file->data + handle->position, to_read);
-        handle->position += to_read;
-        
-        return to_read;
+        return file->iops->read(file, buf, count, &handle->position);
     }
 
     vfs_ssize_t vfs_writefd(int fd, const void* buf, size_t count) {
@@ -502,51 +1153,52 @@
         if (!(handle->flags & VFS_WRITE)) return -EACCES;
         
         vfs_file_t* file = handle->file;
-        
-        if (fd == 1 || fd == 2 || fd == DEV_STDOUT_FD || fd == DEV_STDERR_FD) {
-            return count;
-        }
-        
         if (!file) return -EBADF;
         
-        if (file->type == VFS_TYPE_DEVICE) {
-            if (!file->ops.write) {
-                return -EACCES;
-            }
-            return file->ops.write(file, buf, count, &handle->position);
+        if (!file->iops || !file->iops->write) {
+            return -EACCES;
         }
-        
-        if (handle->position + count > MAX_FILE_SIZE) {
-            count = MAX_FILE_SIZE - handle->position;
+        if (handle->flags & VFS_APPEND) {
+            handle->position = file->size;
         }
-        
-        if (count == 0) return -ENOSPC;
-        
-        memcpy(file->data + handle->position, buf, count);
-        handle->position += count;
-        
-        if (handle->position > file->size) {
-            file->size = handle->position;
+        return file->iops->write(file, buf, count, &handle->position);
+    }
+
+    // Add data to the end of filename, creating it if needed. Only the new
+    // bytes are copied, so repeated appends stay linear in the data written.
+    vfs_ssize_t vfs_append(const char* filename, const void* data, size_t size) {
+        if (!root_mount) return -ENOSYS;
+
+        vfs_file_t* file = vfs_resolve(filename, NULL);
+        if (!file) {
+            int idx = vfs_create(filename, "", 0);
+            if (idx < 0) return -ENOSPC;
+            file = &files[idx];
         }
-        
-        return count;
+
+        if (file->type == VFS_TYPE_DIR) return -EACCES;
+        if (!file->iops || !file->iops->write) return -EACCES;
+        if (size == 0) return 0;
+
+        vfs_off_t pos = file->size;
+        return file->iops->write(file, data, size, &pos);
     }
 
     int vfs_close(int fd) {
         if (fd < 3) return 0;
         
-        for (int i = 0; i < MAX_HANDLES; i++) {
-            if (handles[i].used && handles[i].fd == fd) {
-                handles[i].used = false;
-                handles[i].fd = -1;
-                handles[i].file = NULL;
-                handles[i].position = 0;
-                handles[i].flags = 0;
-                return 0;
-            }
+        vfs_handle_t* handle = get_handle(fd);
+        if (!handle) return -1;
+        
+        if (fd < VFS_MAX_FDS) {
+            current_fds->fds[fd] = NULL;
+            current_fds->used &= ~(1ULL << fd);
+        } else {
+            current_fds->dev[fd - DEV_NULL_FD] = NULL;
         }
         
-        return -1;
+        handle_put(handle);
+        return 0;
     }
 
     vfs_off_t vfs_seek(int fd, vfs_off_t offset, int whence) {
@@ -556,8 +1208,8 @@
         vfs_file_t* file = handle->file;
         if (!file) return -2;
         
-        if (file->type == VFS_TYPE_DEVICE && file->ops.seek) {
-            return file->ops.seek(file, offset, whence, &handle->position);
+        if (file->iops && file->iops->seek) {
+            return file->iops->seek(file, offset, whence, &handle->position);
         }
         
         vfs_off_t new_pos;
@@ -576,42 +1228,119 @@
                 return -3;
         }
         
+        // Seeking past the end is allowed; a later write leaves a hole
         if (new_pos < 0) new_pos = 0;
-        if (new_pos > file->size) new_pos = file->size;
+        if (new_pos > MAX_FILE_SIZE) new_pos = MAX_FILE_SIZE;
         
         handle->position = new_pos;
         return new_pos;
     }
 
+    // Deletes a file, or a directory together with everything below it
     int vfs_delete(const char* filename) {
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-                if (files[i].type == VFS_TYPE_DEVICE && files[i].dev_data) {
-                }
-                
-                for (int j = 0; j < MAX_HANDLES; j++) {
-                    if (handles[j].used && handles[j].file == &files[i]) {
-                        handles[j].used = false;
-                        handles[j].fd = -1;
-                        handles[j].file = NULL;
-                    }
-                }
-                
-                files[i].used = false;
-                files[i].size = 0;
-                files[i].name[0] = '\0';
-                files[i].data[0] = '\0';
-                files[i].type = VFS_TYPE_FILE;
-                files[i].ops.read = NULL;
-                files[i].ops.write = NULL;
-                files[i].ops.seek = NULL;
-                files[i].ops.ioctl = NULL;
-                files[i].dev_data = NULL;
-                return 0;
+        if (!rootfs_owns(filename) || path_has_mount(filename)) return -1;
+
+        int top = vfs_lookup(filename);
+        if (top < 0 || vfs_strcmp(files[top].name, "/") == 0) return -1;
+
+        // Post-order walk: release the deepest first child until top is a leaf
+        int i = top;
+        while (true) {
+            while (files[i].first_child >= 0) {
+                i = files[i].first_child;
             }
+            int parent = files[i].parent;
+            vfs_release_node(i);
+            if (i == top) break;
+            i = parent;
         }
-        
-        return -1;
+        return 0;
+    }
+
+    int vfs_rename(const char* oldpath, const char* newpath) {
+        if (!rootfs_owns(oldpath) || path_has_mount(oldpath)) return -1;
+        if (!rootfs_owns(newpath)) return -5;
+
+        int top = vfs_lookup(oldpath);
+        if (top < 0 || vfs_strcmp(files[top].name, "/") == 0) return -1;
+        if (vfs_lookup(newpath) >= 0) return -2;
+
+        int old_len = vfs_strlen(files[top].name);
+        int new_len = vfs_strlen(newpath);
+
+        // Refuse to move a directory inside itself
+        if (new_len > old_len && newpath[old_len] == '/' &&
+            vfs_strncmp(newpath, files[top].name, old_len) == 0) {
+            return -3;
+        }
+
+        // Check every renamed path still fits before touching anything
+        int i = top;
+        while (i >= 0) {
+            if (vfs_strlen(files[i].name) - old_len + new_len >= MAX_FILENAME) return -4;
+            if (files[i].first_child >= 0) {
+                i = files[i].first_child;
+                continue;
+            }
+            while (i != top && files[i].next_sibling < 0) i = files[i].parent;
+            i = (i == top) ? -1 : files[i].next_sibling;
+        }
+
+        int parent = vfs_parent_dir(newpath);
+        if (parent < 0 && parent_len(newpath) >= 0) return -5;
+
+        tree_unlink(top);
+        tree_link(parent, top);
+
+        // Pre-order walk rewriting the path prefix of each node
+        char renamed[MAX_FILENAME];
+        i = top;
+        while (i >= 0) {
+            dentry_remove(i);
+            vfs_strcpy(renamed, newpath);
+            vfs_strcpy(renamed + new_len, files[i].name + old_len);
+            vfs_strcpy(files[i].name, renamed);
+            dentry_insert(i);
+
+            if (files[i].first_child >= 0) {
+                i = files[i].first_child;
+                continue;
+            }
+            while (i != top && files[i].next_sibling < 0) i = files[i].parent;
+            i = (i == top) ? -1 : files[i].next_sibling;
+        }
+        return 0;
+    }
+
+    int vfs_opendir(const char* path, vfs_dir_t* dir) {
+        char normalized[MAX_FILENAME];
+        int len = vfs_strlen(path);
+        if (len >= MAX_FILENAME) return -1;
+
+        vfs_strcpy(normalized, path);
+        if (len > 1 && normalized[len - 1] == '/') {
+            normalized[len - 1] = '\0';
+        }
+
+        vfs_mount_t* mount;
+        vfs_file_t* file = vfs_resolve(normalized, &mount);
+        if (!file || file->type != VFS_TYPE_DIR || !mount->ops->readdir) return -1;
+
+        dir->mount = mount;
+        dir->dir = file;
+        dir->cookie = 0;
+        return 0;
+    }
+
+    vfs_file_t* vfs_readdir(vfs_dir_t* dir) {
+        if (!dir->mount || dir->cookie < 0) return NULL;
+        return dir->mount->ops->readdir(dir->mount, dir->dir, &dir->cookie);
+    }
+
+    const char* vfs_basename(const vfs_file_t* file) {
+        int len = parent_len(file->name);
+        if (len < 0) return file->name;
+        return file->name + (len == 1 ? 1 : len + 1);
     }
 
     int vfs_ioctl(int fd, unsigned long request, void* arg) {
@@ -621,48 +1350,37 @@
         vfs_file_t* file = handle->file;
         if (!file) return -2;
         
-        if (file->type == VFS_TYPE_DEVICE && file->ops.ioctl) {
-            return file->ops.ioctl(file, request, arg);
+        if (file->iops && file->iops->ioctl) {
+            return file->iops->ioctl(file, request, arg);
         }
         
         return -ENOTTY;
     }
 
+    int vfs_stat(const char* path, vfs_stat_t* st) {
+        vfs_mount_t* mount;
+        vfs_file_t* file = vfs_resolve(path, &mount);
+        if (!file) return -1;
+        if (!mount->ops->stat) return -ENOSYS;
+        return mount->ops->stat(mount, file, st);
+    }
+
     bool vfs_exists(const char* filename) {
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-                return true;
-            }
-        }
-        return false;
+        return vfs_resolve(filename, NULL) != NULL;
     }
 
     bool vfs_is_dir(const char* path) {
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, path) == 0) {
-                return files[i].type == VFS_TYPE_DIR;
-            }
-        }
-        return false;
+        vfs_file_t* file = vfs_resolve(path, NULL);
+        return file && file->type == VFS_TYPE_DIR;
     }
 
     bool vfs_is_device(const char* path) {
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used && vfs_strcmp(files[i].name, path) == 0) {
-                return files[i].type == VFS_TYPE_DEVICE;
-            }
-        }
-        return false;
+        vfs_file_t* file = vfs_resolve(path, NULL);
+        return file && file->type == VFS_TYPE_DEVICE;
     }
 
     int vfs_count(void) {
-        int count = 0;
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (files[i].used) {
-                count++;
-            }
-        }
-        return count;
+        return MAX_FILES - free_file_count;
     }
 
     vfs_file_t* vfs_get_files(void) {
@@ -670,53 +1388,22 @@
     }
 
     void vfs_list_dir(const char* dirname) {
-        int dir_len = vfs_strlen(dirname);
-        
-        char normalized_dir[MAX_FILENAME];
-        vfs_strcpy(normalized_dir, dirname);
-        if (dir_len > 1 && normalized_dir[dir_len - 1] == '/') {
-            normalized_dir[dir_len - 1] = '\0';
-            dir_len--;
-        }
-        
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (!files[i].used) continue;
-            
-            const char* name = files[i].name;
-            bool should_show = false;
-            
-            if (dir_len == 1 && normalized_dir[0] == '/') {
-                if (name[0] == '/' && name[1] != '\0') {
-                    int slash_count = 0;
-                    for (int j = 1; name[j] != '\0'; j++) {
-                        if (name[j] == '/') slash_count++;
-                    }
-                    if (slash_count == 0) {
-                        should_show = true;
-                    }
-                }
-            } else {
-                int name_len = vfs_strlen(name);
-                if (name_len > dir_len && 
-                    name[dir_len] == '/' &&
-                    vfs_strncmp(name, normalized_dir, dir_len) == 0) {
-                    int slash_count = 0;
-                    for (int j = dir_len + 1; name[j] != '\0'; j++) {
-                        if (name[j] == '/') slash_count++;
-                    }
-                    if (slash_count == 0) {
-                        should_show = true;
-                    }
-                }
-            }
+        vfs_dir_t dir;
+        if (vfs_opendir(dirname, &dir) != 0) return;
+
+        LOG_DEBUG("Directory %s:\n", dirname);
+        vfs_file_t* entry;
+        while ((entry = vfs_readdir(&dir)) != NULL) {
+            LOG_DEBUG("  %s (%d bytes, type=%d)\n", vfs_basename(entry), entry->size, entry->type);
         }
     }
 
     void vfs_list(void) {
         int count = 0;
+        int total = vfs_count();
 
         LOG_DEBUG("VFS Contents:\n");
-        for (int i = 0; i < MAX_FILES; i++) {
+        for (int i = 0; i < MAX_FILES && count < total; i++) {
             if (files[i].used) {
                 count++;
                 LOG_DEBUG("  [%d] %s (%d bytes, type=%d)\n", i, files[i].name, files[i].size, files[i].type);
@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
+#define LOG_SUBSYSTEM LOG_SUBSYS_BOOT
+
 #include <core/kernel/kstd.h>
 #include <core/kernel/mem.h>
 #include <core/kernel/nvm/nvm.h>
@@ -11,6 +13,10 @@
 #include <core/drivers/cdrom.h>
 #include <core/kernel/shell.h>
 #include <core/kernel/log.h>
+#include <core/kernel/ktime.h>
+#include <core/arch/cpuid.h>
+#include <core/arch/idt.h>
+#include <core/arch/paging.h>
 #include <core/fs/ramfs.h>
 #include <core/fs/initramfs.h>
 #include <core/fs/iso9660.h>
@@ -35,11 +41,6 @@ static volatile struct limine_bootloader_info_request bootloader_info_request =
     .revision = 0
 };
 
-static volatile struct limine_executable_address_request kernel_address_request = {
-    .id = { LIMINE_COMMON_MAGIC, 0x71ba76863cc55f63, 0xb2644a48c516a487 },
-    .revision = 0
-};
-
 static volatile struct limine_mp_request smp_request = {
     .id = { LIMINE_COMMON_MAGIC, 0x95a67b819a1b857e, 0xa0b61b723b6a73e0 },
     .revision = 0,
@@ -51,6 +52,11 @@ static volatile struct limine_paging_mode_request paging_mode_request = {
     .revision = 0
 };
 
+static volatile struct limine_executable_cmdline_request cmdline_request = {
+    .id = { LIMINE_COMMON_MAGIC, 0x4b161536e598651e, 0xb390ad4a2f1f303a },
+    .revision = 0
+};
+
 void limine_smp_entry(struct limine_mp_info *info) {
     // This function is called on each additional CPU
     // For now, just halt the CPU
@@ -60,13 +66,25 @@ void limine_smp_entry(struct limine_mp_info *info) {
 }
 
 void kmain() {
+    if (cmdline_request.response) {
+        log_parse_cmdline(cmdline_request.response->cmdline);
+    }
+    cpu_features_init();
+    selectMemoryRoutines();
+    idt_init();
+
     kprint(":: Initializing memory manager...\n", 7);
     initializeMemoryManager();
+    paging_init();
+    ktime_init(rsdp_request.response ? rsdp_request.response->address : NULL);
+    fb_init_backbuffer();
 
     init_serial();
+    interrupts_enable();
     ramfs_init();
     vfs_init();
     syslog_init();
+    log_flush();                // Everything so far, to serial and the log file
     keyboard_init();
     
     cdrom_init();
@@ -110,8 +128,10 @@ void kmain() {
         iso9660_init(iso_location, iso_size);
         LOG_DEBUG("ISO9660 filesystem mounted\n");
 
+        log_flush();                // In case the mount never returns
+        uint64_t mount_start = ktime_ns();
         iso9660_mount_to_vfs("/", "/");
-        LOG_DEBUG("ISO contents mounted to /\n");
+        LOG_INFO("ISO mounted to / in %llu us\n", (ktime_ns() - mount_start) / NSEC_PER_USEC);
 
         // Debug: check if font file was mounted
         LOG_DEBUG("Checking mounted files...\n");
@@ -148,36 +168,17 @@ void kmain() {
     LOG_DEBUG("Initramfs loaded\n");
     nvm_init();
     LOG_DEBUG("NVM initialized\n");
+    log_flush();
     LOG_DEBUG("Userspace programs registered\n");
 
+    // Other initramfs programs are started on demand from the shell
     size_t program_count = initramfs_get_count();
     LOG_DEBUG("Initramfs program count: %d\n", program_count);
     if (program_count > 0) {
         for (size_t i = 0; i < program_count; i++) {
             struct program* prog = initramfs_get_program(i);
-            if (prog && prog->size > 0) {
-                char buf[32];
-                int n = i;
-                char* p = buf;
-                if (n == 0) {
-                    *p++ = '0';
-                } else {
-                    char* start = p;
-                    while (n > 0) {
-                        *p++ = '0' + n % 10;
-                        n /= 10;
-                    }
-                    p--;
-                    while (start < p) {
-                        char temp = *start;
-                        *start = *p;
-                        *p = temp;
-                        start++;
-                        p--;
-                    }
-                }
-                *p = '\0';
-                
+            if (prog && prog->size > 0 && (prog->flags & INITRAMFS_FLAG_AUTOSTART) &&
+                initramfs_open(prog)) {
                 nvm_execute((uint8_t*)prog->data, prog->size, (uint16_t[]){CAP_ALL}, 1);
             }
         }
@@ -185,7 +186,9 @@ void kmain() {
         kprint(":: No programs found in initramfs\n", 14);
     }
 
+     LOG_INFO("Time to shell: %llu us since ktime_init\n", ktime_ns() / NSEC_PER_USEC);
      shell_init();
+     log_flush();
      shell_run();
 
     // while(true) {
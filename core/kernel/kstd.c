@@ -46,36 +46,355 @@ void strcat_safe(char *dest, const char *src, size_t max_len) {
     dest[dest_len + i] = '\0';
 }
 
+// "00".."99", so decimal conversion emits two digits per division
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char lower_digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+static const char upper_digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// Both write backwards from end and return the first digit
+static char* u64_to_dec(uint64_t value, char* end) {
+    while (value >= 100) {
+        unsigned int pair = (unsigned int)(value % 100) * 2;
+        value /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        unsigned int pair = (unsigned int)value * 2;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+static char* u64_to_base(uint64_t value, char* end, unsigned int base, bool upper) {
+    const char* digits = upper ? upper_digits : lower_digits;
+
+    if (base == 10) return u64_to_dec(value, end);
+    if ((base & (base - 1)) == 0) {
+        unsigned int shift = __builtin_ctz(base);
+        do {
+            *--end = digits[value & (base - 1)];
+            value >>= shift;
+        } while (value);
+        return end;
+    }
+    do {
+        *--end = digits[value % base];
+        value /= base;
+    } while (value);
+    return end;
+}
+
 char* itoa(int num, char* str, int base) {
-    int i = 0;
-    bool is_negative = false;
+    char tmp[34];
+    char* end = tmp + sizeof(tmp);
+    char* p;
+
+    if (base < 2 || base > 36) base = 10;
+    if (base == 10) {
+        uint64_t magnitude = num < 0 ? -(int64_t)num : num;
+        p = u64_to_dec(magnitude, end);
+        if (num < 0) *--p = '-';
+    } else {
+        p = u64_to_base((unsigned int)num, end, base, false);
+    }
+
+    size_t len = end - p;
+    for (size_t i = 0; i < len; i++) {
+        str[i] = p[i];
+    }
+    str[len] = '\0';
+    return str;
+}
+
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t pos;                 // Characters produced, even past size
+} fmt_out_t;
+
+static inline void out_char(fmt_out_t* out, char c) {
+    if (out->pos + 1 < out->size) out->buf[out->pos] = c;
+    out->pos++;
+}
 
-    if (num == 0) {
-        str[i++] = '0';
-        str[i] = '\0';
-        return str;
+static void out_repeat(fmt_out_t* out, char c, int count) {
+    while (count-- > 0) out_char(out, c);
+}
+
+static void out_chars(fmt_out_t* out, const char* str, size_t len) {
+    for (size_t i = 0; i < len; i++) out_char(out, str[i]);
+}
+
+#define FMT_LEFT    0x01
+#define FMT_ZERO    0x02
+#define FMT_PLUS    0x04
+#define FMT_SPACE   0x08
+#define FMT_ALT     0x10
+
+typedef struct {
+    int flags;
+    int width;
+    int precision;              // -1 if none
+    int length;                 // 'H' = hh, 'h', 0, 'l' (also ll, z, j, t)
+    int stars;                  // '*' widths/precisions consumed
+    char conv;
+} fmt_spec_t;
+
+// Parse the spec after a '%'. '*' values are fetched through next_arg,
+// or just counted when next_arg is NULL.
+static const char* parse_spec(const char* fmt, fmt_spec_t* spec, fmt_arg_t next_arg, void* ctx) {
+    spec->flags = 0;
+    spec->width = 0;
+    spec->precision = -1;
+    spec->length = 0;
+    spec->stars = 0;
+
+    for (;; fmt++) {
+        if (*fmt == '-') spec->flags |= FMT_LEFT;
+        else if (*fmt == '0') spec->flags |= FMT_ZERO;
+        else if (*fmt == '+') spec->flags |= FMT_PLUS;
+        else if (*fmt == ' ') spec->flags |= FMT_SPACE;
+        else if (*fmt == '#') spec->flags |= FMT_ALT;
+        else break;
     }
 
-    if (num < 0 && base == 10) {
-        is_negative = true;
-        num = -num;
+    if (*fmt == '*') {
+        int width = next_arg ? (int)next_arg(ctx, FMT_ARG_INT) : 0;
+        if (width < 0) {
+            spec->flags |= FMT_LEFT;
+            width = -width;
+        }
+        spec->width = width;
+        spec->stars++;
+        fmt++;
+    } else {
+        while (*fmt >= '0' && *fmt <= '9') {
+            spec->width = spec->width * 10 + (*fmt++ - '0');
+        }
     }
 
-    while (num != 0) {
-        int rem = num % base;
-        str[i++] = (rem > 9) ? (rem - 10) + 'a' : rem + '0';
-        num /= base;
+    if (*fmt == '.') {
+        fmt++;
+        spec->precision = 0;
+        if (*fmt == '*') {
+            int precision = next_arg ? (int)next_arg(ctx, FMT_ARG_INT) : 0;
+            spec->precision = precision < 0 ? -1 : precision;
+            spec->stars++;
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                spec->precision = spec->precision * 10 + (*fmt++ - '0');
+            }
+        }
     }
 
-    if (is_negative) {
-        str[i++] = '-';
+    if (*fmt == 'h') {
+        fmt++;
+        spec->length = 'h';
+        if (*fmt == 'h') {
+            fmt++;
+            spec->length = 'H';
+        }
+    } else if (*fmt == 'l' || *fmt == 'z' || *fmt == 'j' || *fmt == 't') {
+        if (fmt[0] == 'l' && fmt[1] == 'l') fmt++;
+        fmt++;
+        spec->length = 'l';
     }
 
-    str[i] = '\0';
+    spec->conv = *fmt;
+    return *fmt ? fmt + 1 : fmt;
+}
 
-    reverse(str, i);
+static int spec_kind(const fmt_spec_t* spec) {
+    switch (spec->conv) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+            return spec->length == 'l' ? FMT_ARG_LONG : FMT_ARG_INT;
+        case 'c': return FMT_ARG_INT;
+        case 'p': return FMT_ARG_PTR;
+        case 's': return FMT_ARG_STR;
+        default: return -1;
+    }
+}
 
-    return str;
+static void format_integer(fmt_out_t* out, const fmt_spec_t* spec, uint64_t raw) {
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    const char* prefix = "";
+    bool is_signed = spec->conv == 'd' || spec->conv == 'i';
+    uint64_t value;
+
+    // Narrow to the argument's real width first
+    if (spec->length == 'l') value = raw;
+    else if (spec->length == 'h') value = is_signed ? (uint64_t)(int64_t)(short)raw : (unsigned short)raw;
+    else if (spec->length == 'H') value = is_signed ? (uint64_t)(int64_t)(signed char)raw : (unsigned char)raw;
+    else value = is_signed ? (uint64_t)(int64_t)(int)raw : (unsigned int)raw;
+
+    if (is_signed) {
+        if ((int64_t)value < 0) {
+            value = -value;
+            prefix = "-";
+        } else if (spec->flags & FMT_PLUS) {
+            prefix = "+";
+        } else if (spec->flags & FMT_SPACE) {
+            prefix = " ";
+        }
+    }
+
+    char* digits;
+    if (spec->conv == 'x' || spec->conv == 'X' || spec->conv == 'p') {
+        digits = u64_to_base(value, end, 16, spec->conv == 'X');
+        if ((spec->flags & FMT_ALT) && (value || spec->conv == 'p')) {
+            prefix = spec->conv == 'X' ? "0X" : "0x";
+        }
+    } else if (spec->conv == 'o') {
+        digits = u64_to_base(value, end, 8, false);
+        if ((spec->flags & FMT_ALT) && value) prefix = "0";
+    } else {
+        digits = u64_to_dec(value, end);
+    }
+
+    int len = end - digits;
+    if (spec->precision == 0 && value == 0 && spec->conv != 'p') len = 0;
+    int zeros = spec->precision > len ? spec->precision - len : 0;
+    int prefix_len = strlen(prefix);
+    int pad = spec->width - prefix_len - zeros - len;
+
+    if ((spec->flags & FMT_ZERO) && !(spec->flags & FMT_LEFT) && spec->precision < 0) {
+        zeros += pad > 0 ? pad : 0;
+        pad = 0;
+    }
+
+    if (!(spec->flags & FMT_LEFT)) out_repeat(out, ' ', pad);
+    out_chars(out, prefix, prefix_len);
+    out_repeat(out, '0', zeros);
+    out_chars(out, end - len, len);
+    if (spec->flags & FMT_LEFT) out_repeat(out, ' ', pad);
+}
+
+static void format_padded(fmt_out_t* out, const fmt_spec_t* spec, const char* str, size_t len) {
+    int pad = spec->width - (int)len;
+    if (!(spec->flags & FMT_LEFT)) out_repeat(out, ' ', pad);
+    out_chars(out, str, len);
+    if (spec->flags & FMT_LEFT) out_repeat(out, ' ', pad);
+}
+
+int format_arg_kinds(const char* fmt, uint8_t* kinds, int max) {
+    int n = 0;
+
+    while (*fmt) {
+        if (*fmt++ != '%') continue;
+        if (*fmt == '%') {
+            fmt++;
+            continue;
+        }
+
+        fmt_spec_t spec;
+        fmt = parse_spec(fmt, &spec, NULL, NULL);
+        int kind = spec_kind(&spec);
+        if (kind < 0) continue;
+
+        // '*' arguments come before the value they apply to
+        while (spec.stars-- > 0) {
+            if (n < max) kinds[n] = FMT_ARG_INT;
+            n++;
+        }
+        if (n < max) kinds[n] = (uint8_t)kind;
+        n++;
+    }
+    return n;
+}
+
+int format_with(char* buf, size_t size, const char* fmt, fmt_arg_t next_arg, void* ctx) {
+    fmt_out_t out = { buf, size, 0 };
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            out_char(&out, *fmt++);
+            continue;
+        }
+
+        const char* start = fmt++;
+        if (*fmt == '%') {
+            out_char(&out, '%');
+            fmt++;
+            continue;
+        }
+
+        fmt_spec_t spec;
+        fmt = parse_spec(fmt, &spec, next_arg, ctx);
+        int kind = spec_kind(&spec);
+        if (kind < 0) {
+            out_chars(&out, start, fmt - start);    // Unknown, print it as written
+            continue;
+        }
+
+        uint64_t value = next_arg(ctx, kind);
+        switch (spec.conv) {
+            case 's': {
+                const char* str = (const char*)(uintptr_t)value;
+                if (!str) str = "(null)";
+                size_t len = 0;
+                while (str[len] && (spec.precision < 0 || len < (size_t)spec.precision)) len++;
+                format_padded(&out, &spec, str, len);
+                break;
+            }
+            case 'c': {
+                char c = (char)value;
+                format_padded(&out, &spec, &c, 1);
+                break;
+            }
+            case 'p':
+                spec.flags |= FMT_ALT;
+                spec.length = 'l';
+                format_integer(&out, &spec, value);
+                break;
+            default:
+                format_integer(&out, &spec, value);
+                break;
+        }
+    }
+
+    if (size > 0) buf[out.pos < size ? out.pos : size - 1] = '\0';
+    return (int)out.pos;
+}
+
+typedef struct {
+    va_list args;
+} va_ctx_t;
+
+static uint64_t va_next(void* ctx, int kind) {
+    va_ctx_t* va = ctx;
+    switch (kind) {
+        case FMT_ARG_INT: return (uint64_t)(int64_t)va_arg(va->args, int);
+        case FMT_ARG_LONG: return va_arg(va->args, uint64_t);
+        default: return (uintptr_t)va_arg(va->args, void*);
+    }
+}
+
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    va_ctx_t ctx;
+    va_copy(ctx.args, args);
+    int ret = format_with(buf, size, fmt, va_next, &ctx);
+    va_end(ctx.args);
+    return ret;
+}
+
+int snprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = vsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return ret;
 }
 
 size_t strlen(const char* str) {
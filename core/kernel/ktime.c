@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/ktime.h>
+#include <core/kernel/log.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/kstd.h>
+#include <core/drivers/timer.h>
+#include <core/arch/cpuid.h>
+#include <core/arch/idt.h>
+#include <core/arch/paging.h>
+#include <core/arch/pause.h>
+#include <core/arch/tsc.h>
+#include <stdbool.h>
+
+#define PIT_HZ                  1193182ULL
+#define PIT_TICK_DIVISOR        (PIT_HZ / 1000)     // What pit_init() programs
+#define PIT_CALIBRATE_MS        10
+#define PIT_CALIBRATE_LATCH     (PIT_HZ * PIT_CALIBRATE_MS / 1000)
+#define CALIBRATE_RUNS          3
+
+#define HPET_REG_CAPS           0x000
+#define HPET_REG_CONFIG         0x010
+#define HPET_REG_COUNTER        0x0F0
+#define HPET_CAPS_COUNT_64      (1ULL << 13)
+#define HPET_CONFIG_ENABLE      (1ULL << 0)
+#define HPET_MAX_PERIOD_FS      100000000ULL        // 100 ns, per the spec
+
+#define FS_PER_SEC              1000000000000000ULL
+
+typedef struct {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    uint32_t length;                // ACPI 2.0+ from here on
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t event_timer_block_id;
+    uint8_t address_space;          // 0 = system memory
+    uint8_t register_bit_width;
+    uint8_t register_bit_offset;
+    uint8_t reserved;
+    uint64_t address;
+    uint8_t hpet_number;
+    uint16_t minimum_tick;
+    uint8_t page_protection;
+} __attribute__((packed)) acpi_hpet_t;
+
+static ktime_source_t source = KTIME_SOURCE_NONE;
+
+// ns = (counter - base) * mult >> 32 for the TSC and HPET
+static uint64_t clock_base;
+static uint64_t clock_mult;
+static uint64_t tsc_hz;
+
+static volatile uint64_t* hpet_regs;
+static uint64_t hpet_period_fs;
+static bool hpet_64bit;
+
+static volatile uint64_t pit_ticks;
+
+static uint64_t mult_for_hz(uint64_t hz) {
+    return ((NSEC_PER_SEC << 32) + hz / 2) / hz;
+}
+
+static inline uint64_t scale(uint64_t delta) {
+    return (uint64_t)(((unsigned __int128)delta * clock_mult) >> 32);
+}
+
+static bool acpi_checksum_ok(const void* table, size_t length) {
+    const uint8_t* bytes = table;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++) sum += bytes[i];
+    return sum == 0;
+}
+
+static void* acpi_find_table(void* rsdp_ptr, const char* signature) {
+    // Base revision 0 hands out the RSDP through the HHDM, newer ones
+    // physical; accept both.
+    uint64_t hhdm = (uint64_t)physicalToVirtual(0);
+    acpi_rsdp_t* rsdp = (uint64_t)rsdp_ptr < hhdm ? physicalToVirtual((uint64_t)rsdp_ptr) : rsdp_ptr;
+
+    if (memcmp(rsdp->signature, "RSD PTR ", 8) != 0 || !acpi_checksum_ok(rsdp, 20)) {
+        return NULL;
+    }
+
+    bool xsdt = rsdp->revision >= 2 && rsdp->xsdt_address;
+    acpi_sdt_header_t* root = physicalToVirtual(xsdt ? rsdp->xsdt_address : rsdp->rsdt_address);
+    if (!acpi_checksum_ok(root, root->length)) return NULL;
+
+    size_t entry_size = xsdt ? 8 : 4;
+    size_t entries = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t* table = (uint8_t*)(root + 1);
+
+    for (size_t i = 0; i < entries; i++) {
+        uint64_t phys = 0;
+        memcpy(&phys, table + i * entry_size, entry_size);
+
+        acpi_sdt_header_t* header = physicalToVirtual(phys);
+        if (memcmp(header->signature, signature, 4) == 0 &&
+            acpi_checksum_ok(header, header->length)) {
+            return header;
+        }
+    }
+    return NULL;
+}
+
+static inline uint64_t hpet_read(uint64_t reg) {
+    return hpet_regs[reg / 8];
+}
+
+static inline void hpet_write(uint64_t reg, uint64_t value) {
+    hpet_regs[reg / 8] = value;
+}
+
+static inline uint64_t hpet_delta(uint64_t start, uint64_t end) {
+    return hpet_64bit ? end - start : (uint32_t)(end - start);
+}
+
+static bool hpet_init(void* rsdp) {
+    if (!rsdp) return false;
+
+    acpi_hpet_t* table = acpi_find_table(rsdp, "HPET");
+    if (!table || table->address_space != 0 || !table->address) return false;
+
+    // Registers must not be cached; the HHDM maps this window write-back
+    uint64_t phys = table->address & ~(PAGE_SIZE - 1);
+    if (paging_is_enabled()) {
+        paging_map_page(paging_kernel_pml4(), (uint64_t)physicalToVirtual(phys), phys,
+                        PAGE_KERNEL | PAGE_CACHE_UC);
+    }
+    hpet_regs = physicalToVirtual(table->address);
+
+    uint64_t caps = hpet_read(HPET_REG_CAPS);
+    hpet_period_fs = caps >> 32;
+    if (hpet_period_fs == 0 || hpet_period_fs > HPET_MAX_PERIOD_FS) {
+        hpet_regs = NULL;
+        return false;
+    }
+    hpet_64bit = caps & HPET_CAPS_COUNT_64;
+
+    hpet_write(HPET_REG_CONFIG, hpet_read(HPET_REG_CONFIG) | HPET_CONFIG_ENABLE);
+    return true;
+}
+
+// One PIT_CALIBRATE_MS one-shot on channel 2, which is gated through port
+// 0x61 and raises no interrupt. Returns the TSC rate it implies.
+static uint64_t pit_calibrate_once(void) {
+    uint8_t gate = inb(0x61);
+    outb(0x61, (gate & ~0x02) | 0x01);      // Gate on, speaker off
+
+    outb(0x43, 0xB0);                       // Channel 2, lo/hi byte, mode 0
+    outb(0x42, PIT_CALIBRATE_LATCH & 0xFF);
+    outb(0x42, PIT_CALIBRATE_LATCH >> 8);
+
+    uint64_t start = rdtsc();
+    while (!(inb(0x61) & 0x20)) {}          // OUT2 goes high at terminal count
+    uint64_t end = rdtsc();
+
+    outb(0x61, gate);
+    return (end - start) * PIT_HZ / PIT_CALIBRATE_LATCH;
+}
+
+static uint64_t hpet_calibrate_once(void) {
+    uint64_t target = PIT_CALIBRATE_MS * (FS_PER_SEC / 1000) / hpet_period_fs;
+
+    uint64_t hpet_start = hpet_read(HPET_REG_COUNTER);
+    uint64_t tsc_start = rdtsc();
+    uint64_t hpet_end;
+    do {
+        cpu_relax();
+        hpet_end = hpet_read(HPET_REG_COUNTER);
+    } while (hpet_delta(hpet_start, hpet_end) < target);
+    uint64_t tsc_end = rdtsc();
+
+    // Stay in 64 bits: there is no libgcc for a 128-bit division
+    uint64_t elapsed_ns = hpet_delta(hpet_start, hpet_end) * hpet_period_fs / (FS_PER_SEC / NSEC_PER_SEC);
+    return (tsc_end - tsc_start) * NSEC_PER_SEC / elapsed_ns;
+}
+
+// Lowest of a few runs: an SMI or emulator stall between the reads of the
+// reference clock only ever inflates the TSC delta
+static uint64_t tsc_calibrate(bool use_hpet) {
+    uint64_t flags = irq_save();
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < CALIBRATE_RUNS; i++) {
+        uint64_t hz = use_hpet ? hpet_calibrate_once() : pit_calibrate_once();
+        if (hz < best) best = hz;
+    }
+    irq_restore(flags);
+    return best;
+}
+
+static void pit_tick(void) {
+    pit_ticks++;
+}
+
+void ktime_init(void* rsdp) {
+    bool has_hpet = hpet_init(rsdp);
+    bool has_tsc = cpu_has_feature(CPU_FEATURE_TSC);
+    bool invariant = cpu_has_feature(CPU_FEATURE_INVARIANT_TSC);
+
+    if (has_tsc) {
+        tsc_hz = tsc_calibrate(has_hpet);
+        LOG_INFO("Time: TSC %llu.%03llu MHz (%s), calibrated against %s\n",
+                 (unsigned long long)(tsc_hz / 1000000), (unsigned long long)(tsc_hz / 1000 % 1000),
+                 invariant ? "invariant" : "not invariant", has_hpet ? "HPET" : "PIT");
+    }
+
+    if (has_tsc && tsc_hz && (invariant || !has_hpet || !hpet_64bit)) {
+        if (!invariant) {
+            LOG_WARN("Time: TSC may change rate with power states\n");
+        }
+        clock_mult = mult_for_hz(tsc_hz);
+        clock_base = rdtsc();
+        source = KTIME_SOURCE_TSC;
+    } else if (has_hpet && hpet_64bit) {
+        clock_mult = mult_for_hz(FS_PER_SEC / hpet_period_fs);
+        clock_base = hpet_read(HPET_REG_COUNTER);
+        source = KTIME_SOURCE_HPET;
+    } else if (irq_register(IRQ_PIT, pit_tick) == 0) {
+        pit_init();
+        source = KTIME_SOURCE_PIT;
+    } else {
+        LOG_WARN("Time: no usable clocksource\n");
+        return;
+    }
+
+    LOG_INFO("Time: clocksource %s\n", ktime_source_name());
+}
+
+uint64_t ktime_ns(void) {
+    switch (source) {
+        case KTIME_SOURCE_TSC:
+            return scale(rdtsc() - clock_base);
+        case KTIME_SOURCE_HPET:
+            return scale(hpet_read(HPET_REG_COUNTER) - clock_base);
+        case KTIME_SOURCE_PIT:
+            return pit_ticks * (PIT_TICK_DIVISOR * NSEC_PER_SEC / PIT_HZ);
+        default:
+            return 0;
+    }
+}
+
+ktime_source_t ktime_source(void) {
+    return source;
+}
+
+const char* ktime_source_name(void) {
+    switch (source) {
+        case KTIME_SOURCE_TSC: return "tsc";
+        case KTIME_SOURCE_HPET: return "hpet";
+        case KTIME_SOURCE_PIT: return "pit";
+        default: return "none";
+    }
+}
+
+uint64_t ktime_tsc_hz(void) {
+    return tsc_hz;
+}
@@ -0,0 +1,427 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/log.h>
+#include <core/kernel/mem.h>
+
+static const char* const level_names[] = {
+    "FATAL", "ERROR", "WARN", "INFO", "DEBUG", "TRACE"
+};
+
+uint8_t log_levels[LOG_SUBSYS_COUNT] = {
+    [0 ... LOG_SUBSYS_COUNT - 1] = LOG_DEFAULT_LEVEL
+};
+
+const char* const log_subsys_names[LOG_SUBSYS_COUNT] = {
+    "core", "boot", "nvm", "syscalls", "vfs", "mem", "fb"
+};
+
+// Writers claim a sequence number with one atomic add and own its slot until
+// they publish it. Readers copy a slot and re-check its sequence afterwards,
+// so a record overwritten mid-copy is detected rather than returned torn.
+static log_record_t ring[LOG_RING_SLOTS];
+static uint64_t ring_head = 0;          // Next sequence number to hand out
+
+static uint64_t serial_cursor = 0;
+static uint64_t syslog_cursor = 0;
+static bool syslog_ready = false;
+static bool draining = false;
+
+void log_write(int level, const char* text, size_t len) {
+    if (len > LOG_RECORD_MAX - 1) len = LOG_RECORD_MAX - 1;
+
+    uint64_t seq = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+    log_record_t* rec = &ring[seq & (LOG_RING_SLOTS - 1)];
+
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    rec->site = NULL;
+    rec->level = (uint8_t)level;
+    rec->len = (uint16_t)len;
+    memcpy(rec->text, text, len);
+    rec->text[len] = '\0';
+
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+
+    if (level == LOG_LEVEL_FATAL) {
+        log_flush();
+    }
+}
+
+static void parse_site(log_site_t* site) {
+    int n = format_arg_kinds(site->format, site->types, LOG_MAX_ARGS);
+    if (n > LOG_MAX_ARGS) n = LOG_MAX_ARGS;
+    __atomic_store_n(&site->nargs, (int8_t)n, __ATOMIC_RELEASE);
+}
+
+// The hot path: no formatting, just the raw arguments. Strings are copied
+// behind the argument words since the caller's buffer may be gone by the
+// time the record is rendered; a string arg holds (offset << 16 | length).
+void log_binary(log_site_t* site, ...) {
+    int nargs = __atomic_load_n(&site->nargs, __ATOMIC_ACQUIRE);
+    if (nargs < 0) {
+        parse_site(site);
+        nargs = site->nargs;
+    }
+
+    uint64_t seq = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+    log_record_t* rec = &ring[seq & (LOG_RING_SLOTS - 1)];
+
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    rec->site = site;
+    rec->level = site->level;
+
+    size_t used = nargs * sizeof(uint64_t);
+    va_list args;
+    va_start(args, site);
+    for (int i = 0; i < nargs; i++) {
+        switch (site->types[i]) {
+            case FMT_ARG_INT:
+                rec->args[i] = (uint64_t)(int64_t)va_arg(args, int);
+                break;
+            case FMT_ARG_LONG:
+                rec->args[i] = va_arg(args, uint64_t);
+                break;
+            case FMT_ARG_PTR:
+                rec->args[i] = (uintptr_t)va_arg(args, void*);
+                break;
+            case FMT_ARG_STR: {
+                const char* str = va_arg(args, const char*);
+                if (!str) str = "(null)";
+                size_t len = 0;
+                while (str[len] && used + len < LOG_RECORD_MAX - 1) {
+                    rec->text[used + len] = str[len];
+                    len++;
+                }
+                rec->args[i] = ((uint64_t)used << 16) | len;
+                used += len;
+                break;
+            }
+        }
+    }
+    va_end(args);
+    rec->len = (uint16_t)used;
+
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+
+    if (site->level == LOG_LEVEL_FATAL) {
+        log_flush();
+    }
+}
+
+// Copy the record at *cursor into out and advance. A reader that fell more
+// than a ring behind skips ahead to the oldest record still present.
+// Returns false when there is nothing (yet) to read.
+static bool ring_read(uint64_t* cursor, log_record_t* out) {
+    while (true) {
+        uint64_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+        if (*cursor >= head) return false;
+        if (head - *cursor > LOG_RING_SLOTS) {
+            *cursor = head - LOG_RING_SLOTS;
+        }
+
+        log_record_t* rec = &ring[*cursor & (LOG_RING_SLOTS - 1)];
+        uint64_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        if (seq != *cursor + 1) {
+            if (seq > *cursor + 1) continue;    // Overwritten, resync on head
+            return false;                       // Still being written
+        }
+
+        out->site = rec->site;
+        out->level = rec->level;
+        out->len = rec->len < LOG_RECORD_MAX ? rec->len : LOG_RECORD_MAX - 1;
+        memcpy(out->text, rec->text, out->len);
+        out->text[out->len] = '\0';
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq) continue;
+
+        out->seq = seq;
+        (*cursor)++;
+        return true;
+    }
+}
+
+// The background drain (limit >= 0) only takes a record once the serial
+// TX ring has room for all of it, so it never waits on the UART; a full
+// drain blocks until everything has been sent.
+static void drain(int limit, bool to_syslog) {
+    if (draining) return;
+    draining = true;
+
+    log_record_t rec;
+    char line[LOG_RECORD_MAX];
+    uint64_t next = serial_cursor;
+    for (int i = 0; (limit < 0 || i < limit) && ring_read(&next, &rec); i++) {
+        size_t len = log_render(&rec, line);
+        if (limit < 0) {
+            serial_print(line);
+        } else if (serial_tx_free() < len) {
+            break;
+        } else {
+            serial_write(line, len);
+        }
+        serial_cursor = next;
+    }
+    if (limit < 0) {
+        serial_flush();
+    }
+
+    // kmain flushes right after syslog_init(), so the log file starts from
+    // boot unless more than LOG_RING_SLOTS records came before it
+    if (to_syslog && syslog_ready) {
+        for (int i = 0; (limit < 0 || i < limit) && ring_read(&syslog_cursor, &rec); i++) {
+            size_t len = log_render(&rec, line);
+            vfs_append(SYSLOG_PATH, line, len);
+        }
+    }
+
+    draining = false;
+}
+
+// Background drain, called from idle loops
+void log_drain(void) {
+    drain(LOG_DRAIN_BATCH, true);
+}
+
+// Drain everything now, e.g. before the system stops
+void log_flush(void) {
+    drain(-1, true);
+}
+
+// Serial only: safe when the heap (and so the VFS) can't be trusted
+void log_flush_serial(void) {
+    draining = false;
+    drain(-1, false);
+}
+
+// Compare a (possibly unterminated) word against a name, ignoring case
+static bool word_equals(const char* word, size_t len, const char* name) {
+    for (size_t i = 0; i < len; i++) {
+        char c = word[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        char n = name[i];
+        if (n >= 'A' && n <= 'Z') n += 'a' - 'A';
+        if (c != n) return false;
+    }
+    return name[len] == '\0';
+}
+
+static size_t word_length(const char* word) {
+    size_t len = 0;
+    while (word[len] && word[len] != ' ' && word[len] != '=' &&
+           word[len] != '\n' && word[len] != '\t') {
+        len++;
+    }
+    return len;
+}
+
+static bool starts_with(const char* str, const char* prefix) {
+    while (*prefix) {
+        if (*str++ != *prefix++) return false;
+    }
+    return true;
+}
+
+static int parse_level(const char* word, size_t len) {
+    if (len == 1 && word[0] >= '0' && word[0] <= '0' + LOG_LEVEL_TRACE) {
+        return word[0] - '0';
+    }
+    for (int i = 0; i <= LOG_LEVEL_TRACE; i++) {
+        if (word_equals(word, len, level_names[i])) return i;
+    }
+    return -1;
+}
+
+static int parse_subsys(const char* word, size_t len) {
+    if (word_equals(word, len, "all")) return LOG_SUBSYS_COUNT;
+    for (int i = 0; i < LOG_SUBSYS_COUNT; i++) {
+        if (word_equals(word, len, log_subsys_names[i])) return i;
+    }
+    return -1;
+}
+
+static int set_level(const char* subsys, size_t subsys_len, const char* level, size_t level_len) {
+    int lvl = parse_level(level, level_len);
+    int sub = subsys ? parse_subsys(subsys, subsys_len) : LOG_SUBSYS_COUNT;
+    if (lvl < 0 || sub < 0) return -1;
+
+    if (sub == LOG_SUBSYS_COUNT) {
+        for (int i = 0; i < LOG_SUBSYS_COUNT; i++) {
+            __atomic_store_n(&log_levels[i], (uint8_t)lvl, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&log_levels[sub], (uint8_t)lvl, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+// subsys is a subsystem name or "all" (NULL means all); level is a level
+// name or its number. Returns -1 if either is unknown.
+int log_set_level(const char* subsys, const char* level) {
+    if (!level) return -1;
+    return set_level(subsys, subsys ? strlen(subsys) : 0, level, strlen(level));
+}
+
+// Accepts "loglevel=<level>" and "log.<subsys>=<level>"; other options are
+// left to whoever else reads the command line
+void log_parse_cmdline(const char* cmdline) {
+    const char* p = cmdline;
+    while (p && *p) {
+        while (*p == ' ') p++;
+        if (!*p) break;
+
+        const char* opt = p;
+        while (*p && *p != ' ') p++;
+
+        if (starts_with(opt, "loglevel=")) {
+            const char* level = opt + 9;
+            set_level(NULL, 0, level, p - level);
+        } else if (starts_with(opt, "log.")) {
+            const char* subsys = opt + 4;
+            size_t subsys_len = word_length(subsys);
+            if (subsys[subsys_len] == '=') {
+                const char* level = subsys + subsys_len + 1;
+                set_level(subsys, subsys_len, level, p - level);
+            }
+        }
+    }
+}
+
+// One "subsystem level" line per subsystem
+size_t log_format_levels(char* buf, size_t size) {
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    for (int i = 0; i < LOG_SUBSYS_COUNT; i++) {
+        strcat_safe(buf, log_subsys_names[i], size);
+        strcat_safe(buf, " ", size);
+        strcat_safe(buf, level_names[log_levels[i]], size);
+        strcat_safe(buf, "\n", size);
+    }
+    return strlen(buf);
+}
+
+static vfs_ssize_t sysctl_read(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
+    (void)file;
+    char text[LOG_SUBSYS_COUNT * 20];
+    size_t len = log_format_levels(text, sizeof(text));
+    if ((size_t)*pos >= len) return 0;
+
+    size_t to_copy = len - *pos < count ? len - *pos : count;
+    memcpy(buf, text + *pos, to_copy);
+    *pos += to_copy;
+    return to_copy;
+}
+
+// Each line is "<level>" for every subsystem or "<subsys> <level>";
+// "<subsys>=<level>" also works. A bad line fails the whole write.
+static vfs_ssize_t sysctl_write(vfs_file_t* file, const void* buf, size_t count, vfs_off_t* pos) {
+    (void)file;
+    (void)pos;
+    char text[128];
+    if (count >= sizeof(text)) return -EINVAL;
+    memcpy(text, buf, count);
+    text[count] = '\0';
+
+    char* line = text;
+    while (*line) {
+        char* end = line;
+        while (*end && *end != '\n') end++;
+        bool last = *end == '\0';
+        *end = '\0';
+
+        char* first = line;
+        while (*first == ' ' || *first == '\t') first++;
+        if (*first) {
+            size_t first_len = word_length(first);
+            char* second = first + first_len;
+            while (*second == ' ' || *second == '=' || *second == '\t') second++;
+
+            int ret = *second
+                ? set_level(first, first_len, second, word_length(second))
+                : set_level(NULL, 0, first, first_len);
+            if (ret < 0) return -EINVAL;
+        }
+
+        if (last) break;
+        line = end + 1;
+    }
+    return count;
+}
+
+// Each open handle keeps its own position in the ring (the sequence number
+// in *pos); a read returns as many whole records as fit.
+static vfs_ssize_t kmsg_read(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos) {
+    (void)file;
+    char* out = buf;
+    size_t done = 0;
+    uint64_t cursor = (uint64_t)*pos;
+    log_record_t rec;
+    char line[LOG_RECORD_MAX];
+
+    while (done < count) {
+        uint64_t next = cursor;
+        if (!ring_read(&next, &rec)) break;
+        size_t len = log_render(&rec, line);
+        if (len > count - done) {
+            if (done > 0) break;
+            len = count;                // A record larger than the buffer is cut
+        }
+        memcpy(out + done, line, len);
+        done += len;
+        cursor = next;
+    }
+
+    *pos = (vfs_off_t)cursor;
+    return done;
+}
+
+void syslog_init(void) {
+    const char* init_msg = "=== NovariaOS System Log ===\n";
+    vfs_create(SYSLOG_PATH, init_msg, strlen(init_msg));
+    vfs_pseudo_register("/dev/kmsg", kmsg_read, NULL, NULL, NULL, NULL);
+    vfs_pseudo_register(LOG_SYSCTL_PATH, sysctl_read, sysctl_write, NULL, NULL, NULL);
+    syslog_ready = true;
+}
+
+typedef struct {
+    const log_record_t* rec;
+    int next;
+    char str[LOG_RECORD_MAX];
+} render_ctx_t;
+
+// Hand the formatter the captured arguments; strings are unpacked into a
+// terminated copy, which it is done with before asking for the next one
+static uint64_t record_arg(void* ctx, int kind) {
+    render_ctx_t* render = ctx;
+    const log_record_t* rec = render->rec;
+    if (render->next >= rec->site->nargs) return 0;
+
+    uint64_t value = rec->args[render->next++];
+    if (kind != FMT_ARG_STR) return value;
+
+    size_t offset = value >> 16;
+    size_t len = value & 0xFFFF;
+    if (offset > rec->len) offset = rec->len;
+    if (len > rec->len - offset) len = rec->len - offset;
+    memcpy(render->str, rec->text + offset, len);
+    render->str[len] = '\0';
+    return (uintptr_t)render->str;
+}
+
+// Turn a record back into text: "[LEVEL] message". Returns the length
+// written to out, which must hold LOG_RECORD_MAX bytes.
+size_t log_render(const log_record_t* rec, char* out) {
+    if (!rec->site) {
+        memcpy(out, rec->text, rec->len);
+        out[rec->len] = '\0';
+        return rec->len;
+    }
+
+    render_ctx_t render = { .rec = rec, .next = 0 };
+    size_t len = snprintf(out, LOG_RECORD_MAX, "[%s] ", level_names[rec->level]);
+    len += format_with(out + len, LOG_RECORD_MAX - len, rec->site->format, record_arg, &render);
+    return len < LOG_RECORD_MAX ? len : LOG_RECORD_MAX - 1;
+}
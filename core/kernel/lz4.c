@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/lz4.h>
+#include <core/kernel/mem.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// A block is a run of sequences: a token (literal length << 4 | match
+// length - 4), the literals, then a 16-bit little-endian back-reference.
+// Lengths of 15 continue in following bytes until one is below 255. The
+// last sequence has literals only.
+static bool read_length(const uint8_t** ip, const uint8_t* iend, size_t* len) {
+    uint8_t byte;
+    do {
+        if (*ip >= iend) return false;
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+    return true;
+}
+
+long lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_len) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = ip + src_len;
+    uint8_t* out = dst;
+    uint8_t* op = out;
+    uint8_t* oend = out + dst_len;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !read_length(&ip, iend, &literals)) return -1;
+        if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op)) return -1;
+
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out)) return -1;
+
+        size_t match = token & 15;
+        if (match == 15 && !read_length(&ip, iend, &match)) return -1;
+        match += 4;
+        if (match > (size_t)(oend - op)) return -1;
+
+        const uint8_t* from = op - offset;
+        if (offset >= match) {
+            memcpy(op, from, match);
+            op += match;
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            while (match--) *op++ = *from++;
+        }
+    }
+
+    return (long)(op - out);
+}
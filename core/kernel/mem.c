@@ -1,11 +1,15 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
+#define LOG_SUBSYSTEM LOG_SUBSYS_MEM
+
 #include <core/kernel/mem.h>
 #include <core/kernel/kstd.h>
 #include <core/kernel/log.h>
 #include <core/kernel/vge/fb_render.h>
 #include <lib/bootloader/limine.h>
 #include <core/arch/panic.h>
+#include <core/arch/cpuid.h>
+#include <core/arch/tsc.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdalign.h>
@@ -40,49 +44,19 @@ static uint64_t hhdmOffset = 0;
 
 static void mergeFreeBlocks();
 static bool validateBlock(MemoryBlock* block);
-static void* physicalToVirtual(uint64_t physical);
-static uint64_t virtualToPhysical(void* virtual);
 
 void formatMemorySize(size_t size, char* buffer) {
     const char* units[] = {"B", "KB", "MB", "GB"};
     int unit_index = 0;
-    double formatted_size = (double)size;
+    uint64_t tenths = (uint64_t)size * 10;
 
-    while (formatted_size >= 1024 && unit_index < 3) {
-        formatted_size /= 1024;
+    while (tenths >= 1024 * 10 && unit_index < 3) {
+        tenths /= 1024;
         unit_index++;
     }
 
-    int int_part = (int)formatted_size;
-    int frac_part = (int)((formatted_size - int_part) * 10);
-    
-    char num_buf[32];
-    char* p = num_buf;
-    int n = int_part;
-    
-    if (n == 0) {
-        *p++ = '0';
-    } else {
-        while (n > 0) {
-            *p++ = '0' + n % 10;
-            n /= 10;
-        }
-    }
-    p--;
-
-    char* buf_ptr = buffer;
-    while (p >= num_buf) {
-        *buf_ptr++ = *p--;
-    }
-    *buf_ptr++ = '.';
-    *buf_ptr++ = '0' + frac_part;
-    *buf_ptr++ = ' ';
-    
-    const char* unit = units[unit_index];
-    while (*unit) {
-        *buf_ptr++ = *unit++;
-    }
-    *buf_ptr = '\0';
+    snprintf(buffer, 32, "%llu.%llu %s", (unsigned long long)(tenths / 10),
+             (unsigned long long)(tenths % 10), units[unit_index]);
 }
 
 void initializeMemoryManager(void) {
@@ -239,14 +213,18 @@ static bool validateBlock(MemoryBlock* block) {
 }
 
 
-static void* physicalToVirtual(uint64_t physical) {
+void* physicalToVirtual(uint64_t physical) {
     return (void*)(physical + hhdmOffset);
 }
 
-static uint64_t virtualToPhysical(void* virtual) {
+uint64_t virtualToPhysical(void* virtual) {
     return (uint64_t)virtual - hhdmOffset;
 }
 
+struct limine_memmap_response* getMemoryMap(void) {
+    return memmap_request.response;
+}
+
 size_t getMemTotal() {
     return poolSizeTotal;
 }
@@ -302,7 +280,8 @@ void mm_test() {
     kprint("\n:: Memory test completed\n", 7);
 }
 
-void* memcpy(void* dest, const void* src, size_t n) {
+// Reference byte loops, kept for the benchmark baseline.
+static void* memcpy_bytes(void* dest, const void* src, size_t n) {
     char* d = (char*)dest;
     const char* s = (const char*)src;
     for (size_t i = 0; i < n; i++) {
@@ -311,10 +290,284 @@ void* memcpy(void* dest, const void* src, size_t n) {
     return dest;
 }
 
-void* memset(void* s, int c, size_t n) {
+static void* memset_bytes(void* s, int c, size_t n) {
     char* p = (char*)s;
     for (size_t i = 0; i < n; i++) {
         p[i] = (char)c;
     }
     return s;
-}
\ No newline at end of file
+}
+
+// 8-byte word loops. The destination is aligned first, the source may stay
+// unaligned (x86 handles unaligned loads, stores are what hurt).
+static void* memcpy_words(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    while (n > 0 && ((uintptr_t)d & 7)) {
+        *d++ = *s++;
+        n--;
+    }
+
+    uint64_t* dw = (uint64_t*)d;
+    const uint64_t* sw = (const uint64_t*)s;
+    while (n >= 32) {
+        uint64_t a = sw[0], b = sw[1], c = sw[2], e = sw[3];
+        dw[0] = a; dw[1] = b; dw[2] = c; dw[3] = e;
+        dw += 4;
+        sw += 4;
+        n -= 32;
+    }
+    while (n >= 8) {
+        *dw++ = *sw++;
+        n -= 8;
+    }
+
+    d = (uint8_t*)dw;
+    s = (const uint8_t*)sw;
+    while (n > 0) {
+        *d++ = *s++;
+        n--;
+    }
+    return dest;
+}
+
+static void* memset_words(void* s, int c, size_t n) {
+    uint8_t* p = (uint8_t*)s;
+    uint8_t byte = (uint8_t)c;
+
+    while (n > 0 && ((uintptr_t)p & 7)) {
+        *p++ = byte;
+        n--;
+    }
+
+    uint64_t pattern = 0x0101010101010101ULL * byte;
+    uint64_t* pw = (uint64_t*)p;
+    while (n >= 32) {
+        pw[0] = pattern; pw[1] = pattern; pw[2] = pattern; pw[3] = pattern;
+        pw += 4;
+        n -= 32;
+    }
+    while (n >= 8) {
+        *pw++ = pattern;
+        n -= 8;
+    }
+
+    p = (uint8_t*)pw;
+    while (n > 0) {
+        *p++ = byte;
+        n--;
+    }
+    return s;
+}
+
+// Enhanced rep movsb/stosb: the microcode picks the widest stores itself.
+static void* memcpy_erms(void* dest, const void* src, size_t n) {
+    void* d = dest;
+    asm volatile("rep movsb"
+                 : "+D"(d), "+S"(src), "+c"(n)
+                 :
+                 : "memory");
+    return dest;
+}
+
+static void* memset_erms(void* s, int c, size_t n) {
+    void* d = s;
+    asm volatile("rep stosb"
+                 : "+D"(d), "+c"(n)
+                 : "a"(c)
+                 : "memory");
+    return s;
+}
+
+// Overlapping copy with dest above src: walk down from the end.
+static void memmove_backward(uint8_t* d, const uint8_t* s, size_t n) {
+    d += n;
+    s += n;
+
+    while (n > 0 && ((uintptr_t)d & 7)) {
+        *--d = *--s;
+        n--;
+    }
+
+    uint64_t* dw = (uint64_t*)d;
+    const uint64_t* sw = (const uint64_t*)s;
+    while (n >= 8) {
+        *--dw = *--sw;
+        n -= 8;
+    }
+
+    d = (uint8_t*)dw;
+    s = (const uint8_t*)sw;
+    while (n > 0) {
+        *--d = *--s;
+        n--;
+    }
+}
+
+typedef void* (*memcpy_fn_t)(void* dest, const void* src, size_t n);
+typedef void* (*memset_fn_t)(void* s, int c, size_t n);
+
+// Word loops are safe on every x86_64, so they are the boot-time default
+// until selectMemoryRoutines() has looked at CPUID.
+static memcpy_fn_t memcpy_impl = memcpy_words;
+static memset_fn_t memset_impl = memset_words;
+static const char* mem_routines_name = "word";
+
+void selectMemoryRoutines(void) {
+    if (cpu_has_feature(CPU_FEATURE_ERMS)) {
+        memcpy_impl = memcpy_erms;
+        memset_impl = memset_erms;
+        mem_routines_name = "erms";
+    } else {
+        memcpy_impl = memcpy_words;
+        memset_impl = memset_words;
+        mem_routines_name = "word";
+    }
+
+    LOG_INFO("Memory routines: %s\n", mem_routines_name);
+}
+
+void* memcpy(void* dest, const void* src, size_t n) {
+    return memcpy_impl(dest, src, n);
+}
+
+void* memset(void* s, int c, size_t n) {
+    return memset_impl(s, c, n);
+}
+
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    if (d == s || n == 0) return dest;
+
+    // A forward copy is correct whenever dest does not start inside src.
+    if (d < s || d >= s + n) {
+        return memcpy_impl(dest, src, n);
+    }
+
+    memmove_backward(d, s, n);
+    return dest;
+}
+
+int memcmp(const void* s1, const void* s2, size_t n) {
+    const uint8_t* a = (const uint8_t*)s1;
+    const uint8_t* b = (const uint8_t*)s2;
+
+    while (n >= 8) {
+        if (*(const uint64_t*)a != *(const uint64_t*)b) break;
+        a += 8;
+        b += 8;
+        n -= 8;
+    }
+
+    while (n > 0) {
+        if (*a != *b) return *a - *b;
+        a++;
+        b++;
+        n--;
+    }
+    return 0;
+}
+
+void* memchr(const void* s, int c, size_t n) {
+    const uint8_t* p = (const uint8_t*)s;
+    uint8_t target = (uint8_t)c;
+
+    // Test eight bytes per step: a zero byte in (word ^ pattern) is a match.
+    const uint64_t pattern = 0x0101010101010101ULL * target;
+    while (n >= 8) {
+        uint64_t x = *(const uint64_t*)p ^ pattern;
+        if ((x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL) break;
+        p += 8;
+        n -= 8;
+    }
+
+    while (n > 0) {
+        if (*p == target) return (void*)p;
+        p++;
+        n--;
+    }
+    return NULL;
+}
+
+static void mem_bench_print_num(uint64_t value, int width) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%*llu", width, (unsigned long long)value);
+    kprint(buf, 7);
+}
+
+// Bytes copied per 1000 TSC cycles for one variant at one size.
+static uint64_t mem_bench_copy(memcpy_fn_t fn, void* dst, const void* src, size_t size) {
+    size_t iterations = (4 * 1024 * 1024) / size;
+    if (iterations == 0) iterations = 1;
+
+    fn(dst, src, size); // warm up caches and TLB
+
+    uint64_t start = rdtsc();
+    for (size_t i = 0; i < iterations; i++) {
+        fn(dst, src, size);
+    }
+    uint64_t cycles = rdtsc() - start;
+    if (cycles == 0) cycles = 1;
+
+    return (uint64_t)size * iterations * 1000 / cycles;
+}
+
+static uint64_t mem_bench_fill(memset_fn_t fn, void* dst, size_t size) {
+    size_t iterations = (4 * 1024 * 1024) / size;
+    if (iterations == 0) iterations = 1;
+
+    fn(dst, 0x5A, size);
+
+    uint64_t start = rdtsc();
+    for (size_t i = 0; i < iterations; i++) {
+        fn(dst, 0x5A, size);
+    }
+    uint64_t cycles = rdtsc() - start;
+    if (cycles == 0) cycles = 1;
+
+    return (uint64_t)size * iterations * 1000 / cycles;
+}
+
+void mem_bench(void) {
+    const size_t max_size = 1024 * 1024;
+    bool erms = cpu_has_feature(CPU_FEATURE_ERMS);
+
+    if (!cpu_has_feature(CPU_FEATURE_TSC)) {
+        kprint("membench: no TSC on this CPU\n", 12);
+        return;
+    }
+
+    uint8_t* src = allocateMemory(max_size);
+    uint8_t* dst = allocateMemory(max_size);
+    if (!src || !dst) {
+        kprint("membench: not enough memory for buffers\n", 12);
+        freeMemory(src);
+        freeMemory(dst);
+        return;
+    }
+    memset_impl(src, 0xA5, max_size);
+
+    kprint(":: Memory bandwidth (bytes per 1000 cycles), active: ", 7);
+    kprint(mem_routines_name, 11);
+    kprint("\n", 7);
+    kprint("    size   cpy-byte  cpy-word  cpy-erms   set-byte  set-word  set-erms\n", 7);
+
+    for (size_t size = 16; size <= max_size; size *= 4) {
+        mem_bench_print_num(size, 8);
+        mem_bench_print_num(mem_bench_copy(memcpy_bytes, dst, src, size), 11);
+        mem_bench_print_num(mem_bench_copy(memcpy_words, dst, src, size), 10);
+        if (erms) mem_bench_print_num(mem_bench_copy(memcpy_erms, dst, src, size), 10);
+        else kprint("         -", 7);
+        mem_bench_print_num(mem_bench_fill(memset_bytes, dst, size), 11);
+        mem_bench_print_num(mem_bench_fill(memset_words, dst, size), 10);
+        if (erms) mem_bench_print_num(mem_bench_fill(memset_erms, dst, size), 10);
+        else kprint("         -", 7);
+        kprint("\n", 7);
+    }
+
+    freeMemory(src);
+    freeMemory(dst);
+}
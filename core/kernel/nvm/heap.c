@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/nvm/heap.h>
+#include <core/kernel/mem.h>
+
+// One entry per block, kept outside the arena: bytecode may write any byte
+// of the arena without being able to corrupt the allocator. Neighbouring
+// free blocks are merged as soon as they appear.
+struct nvm_block {
+    uint32_t offset;
+    uint32_t size;  // bytes, a multiple of BLOCK_ALIGN
+    uint32_t used;
+};
+
+typedef struct nvm_block nvm_block_t;
+
+#define BLOCK_ALIGN     8
+#define BLOCKS_INITIAL  16
+
+void nvm_heap_init(nvm_heap_t* heap) {
+    heap->base = NULL;
+    heap->size = 0;
+    heap->blocks = NULL;
+    heap->count = 0;
+    heap->capacity = 0;
+}
+
+void nvm_heap_release(nvm_heap_t* heap) {
+    if (heap->base) {
+        kfree(heap->base);
+    }
+    if (heap->blocks) {
+        kfree(heap->blocks);
+    }
+    nvm_heap_init(heap);
+}
+
+// Make room for one more table entry
+static bool blocks_reserve(nvm_heap_t* heap) {
+    if (heap->count < heap->capacity) return true;
+
+    uint32_t capacity = heap->capacity ? heap->capacity * 2 : BLOCKS_INITIAL;
+    nvm_block_t* blocks = kmalloc(capacity * sizeof(nvm_block_t));
+    if (!blocks) return false;
+
+    if (heap->blocks) {
+        memcpy(blocks, heap->blocks, heap->count * sizeof(nvm_block_t));
+        kfree(heap->blocks);
+    }
+    heap->blocks = blocks;
+    heap->capacity = capacity;
+    return true;
+}
+
+static bool block_insert(nvm_heap_t* heap, uint32_t index, uint32_t offset, uint32_t size) {
+    if (!blocks_reserve(heap)) return false;
+
+    memmove(&heap->blocks[index + 1], &heap->blocks[index],
+            (heap->count - index) * sizeof(nvm_block_t));
+    heap->blocks[index].offset = offset;
+    heap->blocks[index].size = size;
+    heap->blocks[index].used = 0;
+    heap->count++;
+    return true;
+}
+
+static void block_remove(nvm_heap_t* heap, uint32_t index) {
+    memmove(&heap->blocks[index], &heap->blocks[index + 1],
+            (heap->count - index - 1) * sizeof(nvm_block_t));
+    heap->count--;
+}
+
+// Grow the arena so that at least `needed` more bytes fit at the end.
+// Offsets stay valid because everything is relative to base.
+static bool heap_grow(nvm_heap_t* heap, uint32_t needed) {
+    uint32_t new_size = heap->size ? heap->size : NVM_HEAP_INITIAL;
+    while (new_size < heap->size + needed) {
+        new_size *= 2;
+    }
+    if (new_size > NVM_HEAP_MAX) return false;
+
+    // The new tail either extends a free last block or becomes one;
+    // reserve its entry first so a failure leaves the heap untouched
+    nvm_block_t* last = heap->count ? &heap->blocks[heap->count - 1] : NULL;
+    bool extend = last && !last->used;
+    if (!extend && !blocks_reserve(heap)) return false;
+
+    uint8_t* base = kmalloc(new_size);
+    if (!base) return false;
+
+    if (heap->base) {
+        memcpy(base, heap->base, heap->size);
+        kfree(heap->base);
+    }
+
+    uint32_t old_size = heap->size;
+    heap->base = base;
+    heap->size = new_size;
+
+    if (extend) {
+        heap->blocks[heap->count - 1].size += new_size - old_size;
+    } else {
+        block_insert(heap, heap->count, old_size, new_size - old_size);
+    }
+    return true;
+}
+
+static int32_t heap_find_fit(nvm_heap_t* heap, uint32_t size) {
+    for (uint32_t i = 0; i < heap->count; i++) {
+        nvm_block_t* block = &heap->blocks[i];
+        if (block->used || block->size < size) continue;
+
+        // Split off the rest; without a table entry for it the whole
+        // block is handed out instead
+        if (block->size - size >= BLOCK_ALIGN &&
+            block_insert(heap, i + 1, block->offset + size, block->size - size)) {
+            block = &heap->blocks[i];
+            block->size = size;
+        }
+        block->used = 1;
+        return (int32_t)block->offset;
+    }
+
+    return -1;
+}
+
+// Index of the block that contains offset, or -1
+static int32_t block_find(const nvm_heap_t* heap, uint32_t offset) {
+    uint32_t low = 0;
+    uint32_t high = heap->count;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        const nvm_block_t* block = &heap->blocks[mid];
+        if (offset < block->offset) {
+            high = mid;
+        } else if (offset - block->offset >= block->size) {
+            low = mid + 1;
+        } else {
+            return (int32_t)mid;
+        }
+    }
+    return -1;
+}
+
+int32_t nvm_heap_alloc(nvm_heap_t* heap, int32_t size) {
+    if (size <= 0 || size > NVM_HEAP_MAX) return -1;
+
+    uint32_t aligned = ((uint32_t)size + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+
+    if (heap->base) {
+        int32_t offset = heap_find_fit(heap, aligned);
+        if (offset >= 0) return offset;
+    }
+
+    if (!heap_grow(heap, aligned)) return -1;
+    return heap_find_fit(heap, aligned);
+}
+
+bool nvm_heap_free(nvm_heap_t* heap, int32_t offset) {
+    if (!heap->base || offset < 0) return false;
+
+    // Only offsets that nvm_heap_alloc returned are accepted
+    int32_t index = block_find(heap, (uint32_t)offset);
+    if (index < 0) return false;
+
+    nvm_block_t* block = &heap->blocks[index];
+    if (block->offset != (uint32_t)offset || !block->used) return false;
+    block->used = 0;
+
+    uint32_t i = (uint32_t)index;
+    if (i + 1 < heap->count && !heap->blocks[i + 1].used) {
+        heap->blocks[i].size += heap->blocks[i + 1].size;
+        block_remove(heap, i + 1);
+    }
+    if (i > 0 && !heap->blocks[i - 1].used) {
+        heap->blocks[i - 1].size += heap->blocks[i].size;
+        block_remove(heap, i);
+    }
+    return true;
+}
+
+// The arena holds nothing but payload, so any in-range access is safe
+bool nvm_heap_check(const nvm_heap_t* heap, int32_t offset, int32_t len) {
+    if (!heap->base || offset < 0 || len < 0) return false;
+    return (uint32_t)offset + (uint32_t)len <= heap->size;
+}
+
+bool nvm_heap_check_block(const nvm_heap_t* heap, int32_t offset, int32_t len) {
+    if (!nvm_heap_check(heap, offset, len)) return false;
+    if (len == 0) return true;
+
+    int32_t index = block_find(heap, (uint32_t)offset);
+    if (index < 0) return false;
+
+    const nvm_block_t* block = &heap->blocks[index];
+    return block->used && (uint32_t)len <= block->offset + block->size - (uint32_t)offset;
+}
@@ -1,11 +1,16 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
+#define LOG_SUBSYSTEM LOG_SUBSYS_NVM
+
 #include <core/kernel/nvm/syscall.h>
 #include <core/kernel/kstd.h>
+#include <core/kernel/mem.h>
 #include <core/kernel/log.h>
+#include <core/kernel/ktime.h>
 #include <core/drivers/serial.h>
 #include <core/kernel/nvm/nvm.h>
 #include <core/kernel/nvm/caps.h>
+#include <core/kernel/nvm/schedstat.h>
 
 nvm_process_t processes[MAX_PROCESSES];
 uint8_t current_process = 0;
@@ -13,6 +18,27 @@ uint32_t timer_ticks = 0;
 
 int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc);
 
+// Release everything a finished process still owns
+static void nvm_reap_process(nvm_process_t* proc) {
+    nvm_heap_release(&proc->heap);
+
+    if(proc->owns_bytecode) {
+        kfree(proc->bytecode);
+    }
+    proc->owns_bytecode = false;
+    proc->bytecode = NULL;
+
+    vfs_fd_table_destroy(proc->fd_table);
+    proc->fd_table = NULL;
+}
+
+vfs_fd_table_t* nvm_fd_table(nvm_process_t* proc) {
+    if(!proc->fd_table) {
+        proc->fd_table = vfs_fd_table_create();
+    }
+    return proc->fd_table;
+}
+
 void nvm_init() {
     for(int i = 0; i < MAX_PROCESSES; i++) {
         processes[i].active = false;
@@ -20,11 +46,36 @@ void nvm_init() {
         processes[i].ip = 0;
         processes[i].exit_code = 0;
         processes[i].caps_count = 0;
+        processes[i].owns_bytecode = false;
+        processes[i].fd_table = NULL;
+        nvm_heap_init(&processes[i].heap);
     }
 
     kprint(":: NVM initialized\n", 7);
 }
 
+// Resolve a block operand of count units in the given space to a pointer,
+// or NULL if any part of it falls outside. Locals are addressed in words,
+// the heap in bytes; a heap block must stay inside one allocation.
+static uint8_t* nvm_block_ptr(nvm_process_t* proc, uint8_t space, int32_t offset, int32_t count) {
+    if(offset < 0 || count < 0) {
+        return NULL;
+    }
+
+    if(space == NVM_SPACE_LOCALS) {
+        if(offset > MAX_LOCALS || count > MAX_LOCALS - offset) {
+            return NULL;
+        }
+        return (uint8_t*)&proc->locals[offset];
+    }
+
+    if(space == NVM_SPACE_HEAP && nvm_heap_check_block(&proc->heap, offset, count)) {
+        return proc->heap.base + offset;
+    }
+
+    return NULL;
+}
+
 // Signature checking and process creation
 int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[], uint8_t caps_count) {
     if(bytecode[0] != 0x4E || bytecode[1] != 0x56 ||
@@ -35,6 +86,7 @@ int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[]
 
     for(int i = 0; i < MAX_PROCESSES; i++) {
         if(!processes[i].active) {
+            nvm_reap_process(&processes[i]);
             processes[i].bytecode = bytecode;
             processes[i].ip = 4;
             processes[i].size = size;
@@ -43,6 +95,8 @@ int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[]
             processes[i].exit_code = 0;
             processes[i].pid = i;
             processes[i].caps_count = 0;
+            processes[i].instructions = 0;
+            processes[i].cpu_ns = 0;
 
             // Initializing capabilities
             for(int j = 0; j < caps_count && j < MAX_CAPS; j++) {
@@ -54,6 +108,7 @@ int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[]
                 processes[i].locals[j] = 0;
             }
 
+            schedstat_new(i, ktime_ns());
             return i;
         }
     }
@@ -79,6 +134,7 @@ int nvm_create_process_with_stack(uint8_t* bytecode, uint32_t size,
 
     for(int i = 0; i < MAX_PROCESSES; i++) {
         if(!processes[i].active) {
+            nvm_reap_process(&processes[i]);
             processes[i].bytecode = bytecode;
             processes[i].ip = 4;
             processes[i].size = size;
@@ -88,6 +144,8 @@ int nvm_create_process_with_stack(uint8_t* bytecode, uint32_t size,
             processes[i].caps_count = 0;
             processes[i].blocked = false;
             processes[i].wakeup_reason = 0;
+            processes[i].instructions = 0;
+            processes[i].cpu_ns = 0;
 
             // Initialize stack with provided values
             for(int j = 0; j < stack_count; j++) {
@@ -106,6 +164,7 @@ int nvm_create_process_with_stack(uint8_t* bytecode, uint32_t size,
                 processes[i].locals[j] = 0;
             }
 
+            schedstat_new(i, ktime_ns());
             return i;
         }
     }
@@ -643,18 +702,8 @@ bool nvm_execute_instruction(nvm_process_t* proc) {
                     if (addr >= 0xB8000 && addr <= 0xB8FA0) {
                         *(uint16_t*)addr = (uint16_t)(value & 0xFFFF);
                         
-                        // Debug VGA writes
-                        char dbg[64];
-                        serial_print("VGA WRITE: addr=0x");
-                        itoa(addr, dbg, 16);
-                        serial_print(dbg);
-                        serial_print(" <- value=0x");
-                        itoa(value, dbg, 16);
-                        serial_print(dbg);
-                        serial_print(" (char='");
-                        char ch[2] = {(char)(value & 0xFF), 0};
-                        serial_print(ch);
-                        serial_print("')\n");
+                        LOG_TRACE("VGA WRITE: addr=0x%x <- value=0x%x (char='%c')\n",
+                                  (unsigned int)addr, (unsigned int)value, (char)(value & 0xFF));
                     } else {
                         *(int32_t*)addr = value;
                     }
@@ -673,17 +722,159 @@ bool nvm_execute_instruction(nvm_process_t* proc) {
             }
             break;
 
+        // Heap (linear memory):
+        case 0x46: // ALLOC - pop size, push offset or -1
+            if(proc->sp > 0) {
+                int32_t size = proc->stack[proc->sp - 1];
+                proc->stack[proc->sp - 1] = nvm_heap_alloc(&proc->heap, size);
+            } else {
+                LOG_WARN("process %d: stack underflow in ALLOC\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x47: // FREE - pop offset
+            if(proc->sp > 0) {
+                int32_t offset = proc->stack[--proc->sp];
+                if(!nvm_heap_free(&proc->heap, offset)) {
+                    LOG_WARN("process %d: invalid offset %d in FREE\n", proc->pid, offset);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("process %d: stack underflow in FREE\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x48: // LOAD8
+        case 0x49: // LOAD16
+        case 0x4A: // LOAD32
+            if(proc->sp > 0) {
+                int32_t width = 1 << (opcode - 0x48);
+                int32_t offset = proc->stack[proc->sp - 1];
+
+                if(nvm_heap_check(&proc->heap, offset, width)) {
+                    uint8_t* p = proc->heap.base + offset;
+                    uint32_t value = p[0];
+                    if(width > 1) value |= (uint32_t)p[1] << 8;
+                    if(width > 2) value |= (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+                    proc->stack[proc->sp - 1] = (int32_t)value;
+                } else {
+                    LOG_WARN("process %d: heap access out of bounds at %d\n", proc->pid, offset);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("process %d: stack underflow in LOAD%d\n", proc->pid, 8 << (opcode - 0x48));
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x4B: // STORE8
+        case 0x4C: // STORE16
+        case 0x4D: // STORE32
+            if(proc->sp >= 2) {
+                int32_t width = 1 << (opcode - 0x4B);
+                int32_t offset = proc->stack[proc->sp - 2]; // offset
+                uint32_t value = (uint32_t)proc->stack[proc->sp - 1]; // value
+
+                if(nvm_heap_check(&proc->heap, offset, width)) {
+                    uint8_t* p = proc->heap.base + offset;
+                    p[0] = value & 0xFF;
+                    if(width > 1) p[1] = (value >> 8) & 0xFF;
+                    if(width > 2) {
+                        p[2] = (value >> 16) & 0xFF;
+                        p[3] = (value >> 24) & 0xFF;
+                    }
+                    proc->sp -= 2;
+                } else {
+                    LOG_WARN("process %d: heap access out of bounds at %d\n", proc->pid, offset);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("process %d: stack underflow in STORE%d\n", proc->pid, 8 << (opcode - 0x4B));
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        // Block memory:
+        case 0x60: // BCOPY space - dst src len
+        case 0x61: // BFILL space - dst value len
+        case 0x62: // BCMP space - a b len -> -1/0/1
+        case 0x63: // BFIND space - start value len -> position or -1
+            if(proc->ip < proc->size && proc->sp >= 3) {
+                uint8_t space = proc->bytecode[proc->ip++];
+                int32_t a = proc->stack[proc->sp - 3];
+                int32_t b = proc->stack[proc->sp - 2];
+                int32_t len = proc->stack[proc->sp - 1];
+                size_t unit = (space == NVM_SPACE_LOCALS) ? sizeof(int32_t) : 1;
+
+                uint8_t* pa = nvm_block_ptr(proc, space, a, len);
+                uint8_t* pb = (opcode == 0x60 || opcode == 0x62) ? nvm_block_ptr(proc, space, b, len) : pa;
+                if(!pa || !pb) {
+                    LOG_WARN("process %d: block operand out of bounds (op 0x%x, space %d)\n", proc->pid, opcode, space);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+
+                size_t bytes = (size_t)len * unit;
+                proc->sp -= 3;
+
+                if(opcode == 0x60) {
+                    memmove(pa, pb, bytes);
+                } else if(opcode == 0x61) {
+                    if(unit == 1 || b == 0 || b == -1) {
+                        memset(pa, b & 0xFF, bytes);
+                    } else {
+                        int32_t* words = (int32_t*)pa;
+                        for(int32_t i = 0; i < len; i++) {
+                            words[i] = b;
+                        }
+                    }
+                } else if(opcode == 0x62) {
+                    int result = memcmp(pa, pb, bytes);
+                    proc->stack[proc->sp++] = (result > 0) - (result < 0);
+                } else {
+                    int32_t found = -1;
+                    if(unit == 1) {
+                        uint8_t* hit = memchr(pa, b & 0xFF, bytes);
+                        if(hit) found = a + (int32_t)(hit - pa);
+                    } else {
+                        int32_t* words = (int32_t*)pa;
+                        for(int32_t i = 0; i < len; i++) {
+                            if(words[i] == b) {
+                                found = a + i;
+                                break;
+                            }
+                        }
+                    }
+                    proc->stack[proc->sp++] = found;
+                }
+            } else {
+                LOG_WARN("process %d: stack underflow in block op 0x%x\n", proc->pid, opcode);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
         // System calls:
         case 0x51: // BREAK
-            LOG_DEBUG("process %d: Stop from BREAK\n", proc->pid);
-            char dbg[64];
-            serial_print("IP: ");
-            itoa(proc->ip, dbg, 10);
-            serial_print(dbg);
-            serial_print(", SP: ");
-            itoa(proc->sp, dbg, 10);
-            serial_print(dbg);
-            serial_print("\n");
+            LOG_DEBUG("process %d: Stop from BREAK (IP: %d, SP: %d)\n", proc->pid, (int)proc->ip, (int)proc->sp);
             break;
             
         case 0x50: // SYSCALL
@@ -722,27 +913,36 @@ void nvm_scheduler_tick() {
     } while(current_process != start);
     
     if(processes[current_process].active && !processes[current_process].blocked) {
+        uint64_t slice_start = ktime_ns();
+        schedstat_run(&processes[current_process], slice_start);
+
         // Execute multiple instructions per tick for better performance
         for(int i = 0; i < 100; i++) {
             if (processes[current_process].ip < processes[current_process].size && 
                 processes[current_process].active && 
                 !processes[current_process].blocked) {
+                processes[current_process].instructions++;
                 if(!nvm_execute_instruction(&processes[current_process])) {
                     break; // Stop if instruction returns false (halt, error, etc)
                 }
             } else {
                 if(processes[current_process].ip >= processes[current_process].size && 
                    processes[current_process].active) {
-                    char buffer[32];
-                    itoa(processes[current_process].pid, buffer, 10);
-
-                    LOG_WARN("process %s: Reached end of code - terminating\n", buffer);
+                    LOG_WARN("process %d: Reached end of code - terminating\n", processes[current_process].pid);
                     processes[current_process].active = false;
                     processes[current_process].exit_code = 0;
                 }
                 break;
             }
         }
+
+        uint64_t slice_end = ktime_ns();
+        processes[current_process].cpu_ns += slice_end - slice_start;
+        schedstat_stop(&processes[current_process], slice_start, slice_end);
+
+        if(!processes[current_process].active) {
+            nvm_reap_process(&processes[current_process]);
+        }
     } else {
         current_process = original;
     }
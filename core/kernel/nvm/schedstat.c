@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/nvm/schedstat.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/kstd.h>
+
+typedef struct {
+    sched_stats_t stats;
+    uint64_t runnable_since;    // When it last became runnable
+    bool queued;                // runnable_since is valid
+    bool woken;                 // Queued by a message, not a slice ending
+} pid_sched_t;
+
+static pid_sched_t pids[SCHEDSTAT_PIDS];
+static sched_stats_t global;
+static int last_pid = -1;
+
+static void hist_add(sched_hist_t* hist, uint64_t ns) {
+    int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= SCHEDSTAT_BUCKETS) bucket = SCHEDSTAT_BUCKETS - 1;
+
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum_ns += ns;
+    if (ns > hist->max_ns) hist->max_ns = ns;
+}
+
+static void enqueue(uint8_t pid, bool woken, uint64_t now) {
+    pids[pid].runnable_since = now;
+    pids[pid].queued = true;
+    pids[pid].woken = woken;
+}
+
+void schedstat_new(uint8_t pid, uint64_t now) {
+    memset(&pids[pid].stats, 0, sizeof(sched_stats_t));
+    enqueue(pid, false, now);
+}
+
+void schedstat_wakeup(uint8_t pid, uint64_t now) {
+    enqueue(pid, true, now);
+}
+
+void schedstat_run(nvm_process_t* proc, uint64_t now) {
+    pid_sched_t* entry = &pids[proc->pid];
+
+    if (entry->queued) {
+        uint64_t waited = now - entry->runnable_since;
+        if (entry->woken) {
+            hist_add(&entry->stats.wakeup, waited);
+            hist_add(&global.wakeup, waited);
+        } else {
+            hist_add(&entry->stats.runqueue, waited);
+            hist_add(&global.runqueue, waited);
+        }
+        entry->queued = false;
+    }
+
+    if (last_pid != proc->pid) {
+        entry->stats.switches++;
+        global.switches++;
+        last_pid = proc->pid;
+    }
+}
+
+void schedstat_stop(nvm_process_t* proc, uint64_t start, uint64_t end) {
+    pid_sched_t* entry = &pids[proc->pid];
+
+    hist_add(&entry->stats.slice, end - start);
+    hist_add(&global.slice, end - start);
+
+    if (!proc->active) return;
+    if (proc->blocked) {
+        entry->stats.voluntary++;
+        global.voluntary++;
+    } else {
+        entry->stats.involuntary++;
+        global.involuntary++;
+        enqueue(proc->pid, false, end);
+    }
+}
+
+// Counters only: queued processes keep the time they became runnable
+void schedstat_clear(void) {
+    memset(&global, 0, sizeof(global));
+    for (int i = 0; i < SCHEDSTAT_PIDS; i++) {
+        memset(&pids[i].stats, 0, sizeof(sched_stats_t));
+    }
+}
+
+static void hist_show(seq_file_t* m, const char* name, const sched_hist_t* hist) {
+    seq_printf(m, "%s: count %llu avg %llu ns max %llu ns\n", name,
+               (unsigned long long)hist->count,
+               (unsigned long long)(hist->count ? hist->sum_ns / hist->count : 0),
+               (unsigned long long)hist->max_ns);
+    if (!hist->count) return;
+
+    int first = 0;
+    int last = SCHEDSTAT_BUCKETS - 1;
+    while (!hist->buckets[first]) first++;
+    while (!hist->buckets[last]) last--;
+
+    for (int i = first; i <= last; i++) {
+        unsigned long long low = i ? 1ULL << i : 0;
+        if (i == SCHEDSTAT_BUCKETS - 1) {
+            seq_printf(m, "  %10llu ..        inf ns: %u\n", low, hist->buckets[i]);
+        } else {
+            seq_printf(m, "  %10llu .. %10llu ns: %u\n", low, (2ULL << i) - 1, hist->buckets[i]);
+        }
+    }
+}
+
+void schedstat_show(seq_file_t* m, int pid) {
+    const sched_stats_t* stats = pid < 0 ? &global : &pids[pid].stats;
+
+    seq_printf(m, "switches: %llu\n", (unsigned long long)stats->switches);
+    seq_printf(m, "voluntary: %llu\n", (unsigned long long)stats->voluntary);
+    seq_printf(m, "involuntary: %llu\n", (unsigned long long)stats->involuntary);
+    hist_show(m, "wakeup", &stats->wakeup);
+    hist_show(m, "runqueue", &stats->runqueue);
+    hist_show(m, "slice", &stats->slice);
+}
@@ -1,13 +1,18 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
+#define LOG_SUBSYSTEM LOG_SUBSYS_SYSCALLS
+
 #include <stddef.h>
 #include <string.h>
 #include <core/kernel/nvm/syscall.h>
 #include <core/kernel/nvm/nvm.h>
 #include <core/kernel/nvm/caps.h>
+#include <core/kernel/nvm/schedstat.h>
 #include <core/drivers/serial.h>
 #include <core/kernel/log.h>
+#include <core/kernel/ktime.h>
 #include <core/kernel/mem.h>
+#include <core/kernel/scratch.h>
 #include <core/fs/vfs.h>
 
 extern uint8_t inb(uint16_t port);
@@ -29,14 +34,22 @@ static int message_count = 0;
 
 int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
     int32_t result = 0;
-    char buffer[32];
+    scratch_scope_t scratch = scratch_begin();
+
+    // File syscalls resolve fds in the calling process's own table
+    vfs_fd_table_t* table = nvm_fd_table(proc);
+    if (!table) {
+        LOG_WARN("Process %d: no memory for fd table\n", proc->pid);
+        scratch_end(scratch);
+        return -1;
+    }
+    vfs_fd_table_t* saved_fds = vfs_set_fd_table(table);
     
     switch(syscall_id) {
         case SYS_EXIT: {
             if(proc->sp >= 1) {
                 proc->exit_code = proc->stack[proc->sp - 1];
-                itoa(proc->exit_code, buffer, 10);
-                LOG_DEBUG("Process %d: exited with code: %s\n", proc->pid, buffer);
+                LOG_DEBUG("Process %d: exited with code: %d\n", proc->pid, proc->exit_code);
             } else {
                 proc->exit_code = 0;
             }
@@ -51,7 +64,7 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
                 result = -1;
                 break;
             }
-            if (proc->sp < 1) {
+            if (proc->sp < 2) {
                 LOG_WARN("Process %d: Stack underflow for exec\n", proc->pid);
                 result = -1;
                 break;
@@ -67,8 +80,21 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
 
             proc->sp -= 2;
 
-            char* argv[argc];
+            if (argc < 0 || argc > proc->sp) {
+                LOG_WARN("Process %d: Invalid argc %d\n", proc->pid, argc);
+                result = -1;
+                break;
+            }
+
+            // Everything below is scratch memory, released when the syscall returns
+            char** argv = scratch_alloc((argc > 0 ? argc : 1) * sizeof(char*));
+            if (!argv) {
+                result = -1;
+                break;
+            }
+
             int arg_index = 0;
+            int initial_stack_size = 1;
 
             int stack_pos = proc->sp - 1;
             
@@ -93,9 +119,8 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
 
                 int len = end_pos - start_pos + 1;
 
-                argv[arg_index] = kmalloc(len + 1);
+                argv[arg_index] = scratch_alloc(len + 1);
                 if (!argv[arg_index]) {
-                    LOG_WARN("Process %d: Failed to allocate memory\n", proc->pid);
                     result = -1;
                     break;
                 }
@@ -104,6 +129,7 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
                     argv[arg_index][i] = (char)proc->stack[start_pos + i];
                 }
                 argv[arg_index][len] = '\0';
+                initial_stack_size += len + 1;
                 
                 LOG_TRACE("  argv[%d] = '%s'\n", arg_index, argv[arg_index]);
                 
@@ -111,85 +137,52 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
                 stack_pos = start_pos - 2;
             }
             
-            if (result == -1) {
-                for (int i = 0; i < arg_index; i++) {
-                    kfree(argv[i]);
-                }
+            if (result == -1 || arg_index < argc) {
+                result = -1;
                 break;
             }
 
             proc->sp = stack_pos + 1;
             
-            uint8_t* bytecode = NULL;
+            // Read the image into scratch space, doubling as needed
             size_t bytecode_size = 0;
-            size_t allocated_size = 1024;
+            size_t allocated_size = 4096;
+            uint8_t* image = scratch_alloc(allocated_size);
 
-            bytecode = kmalloc(allocated_size);
-            if (!bytecode) {
-                LOG_WARN("Process %d: Failed to allocate memory for bytecode\n", proc->pid);
-                for (int i = 0; i < argc; i++) {
-                    kfree(argv[i]);
-                }
-                result = -1;
-                break;
-            }
-
-            while (1) {
-                uint8_t read_byte;
-                size_t bytes_read = vfs_readfd(target_fd, &read_byte, 1);
+            while (image) {
+                vfs_ssize_t bytes_read = vfs_readfd(target_fd, image + bytecode_size,
+                                                    allocated_size - bytecode_size);
                 
-                if (bytes_read != 1) {
-                    if (bytes_read == 0) {
+                if (bytes_read <= 0) {
+                    if (bytes_read < 0) {
+                        LOG_WARN("Process %d: Error reading file\n", proc->pid);
+                        image = NULL;
+                    } else {
                         LOG_DEBUG("Process %d: End of file reached, read %d bytes\n", 
                                 proc->pid, bytecode_size);
-                    } else {
-                        LOG_WARN("Process %d: Error reading file\n", proc->pid);
                     }
                     break;
                 }
 
-                if (bytecode_size >= allocated_size) {
-                    allocated_size *= 2;
-                    uint8_t* new_bytecode = kmalloc(allocated_size);
-                    if (!new_bytecode) {
-                        LOG_WARN("Process %d: Failed to reallocate bytecode buffer\n", proc->pid);
-                        kfree(bytecode);
-                        for (int i = 0; i < argc; i++) {
-                            kfree(argv[i]);
-                        }
-                        result = -1;
-                        break;
+                bytecode_size += bytes_read;
+                if (bytecode_size == allocated_size) {
+                    uint8_t* grown = scratch_alloc(allocated_size * 2);
+                    if (grown) {
+                        memcpy(grown, image, bytecode_size);
                     }
-
-                    for (size_t i = 0; i < bytecode_size; i++) {
-                        new_bytecode[i] = bytecode[i];
-                    }
-                    
-                    kfree(bytecode);
-                    bytecode = new_bytecode;
+                    image = grown;
+                    allocated_size *= 2;
                 }
-                
-                bytecode[bytecode_size] = read_byte;
-                bytecode_size++;
-            }
-            
-            if (result == -1) {
-                break;
             }
 
-            int initial_stack_size = 1;
-
-            for (int i = 0; i < argc; i++) {
-                initial_stack_size += strlen(argv[i]) + 1;
+            if (!image || bytecode_size < 4) {
+                LOG_WARN("Process %d: Failed to load bytecode\n", proc->pid);
+                result = -1;
+                break;
             }
 
-            int32_t* initial_stack = kmalloc(initial_stack_size * sizeof(int32_t));
+            int32_t* initial_stack = scratch_alloc(initial_stack_size * sizeof(int32_t));
             if (!initial_stack) {
-                LOG_WARN("Process %d: Failed to allocate initial stack\n", proc->pid);
-                kfree(bytecode);
-                for (int i = 0; i < argc; i++) {
-                    kfree(argv[i]);
-                }
                 result = -1;
                 break;
             }
@@ -206,28 +199,30 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
 
             initial_stack[stack_pos++] = argc;
 
+            // The child owns its image; it is freed when the process is reaped
+            uint8_t* bytecode = kmalloc(bytecode_size);
+            if (!bytecode) {
+                LOG_WARN("Process %d: Failed to allocate memory for bytecode\n", proc->pid);
+                result = -1;
+                break;
+            }
+            memcpy(bytecode, image, bytecode_size);
+
             int new_pid = nvm_create_process_with_stack(bytecode, bytecode_size,
                                                       (uint16_t[]){CAPS_NONE}, 1,
                                                       initial_stack, stack_pos);
-            kfree(initial_stack);
-            caps_copy(proc->pid, new_pid);
 
             if (new_pid < 0) {
                 LOG_WARN("Process %d: Failed to create new process\n", proc->pid);
                 kfree(bytecode);
-                for (int i = 0; i < argc; i++) {
-                    kfree(argv[i]);
-                }
                 result = -1;
                 break;
             }
 
-            LOG_INFO("Process %d: Spawn process with pid %d\n", proc->pid, new_pid);
+            processes[new_pid].owns_bytecode = true;
+            caps_copy(&processes[new_pid], proc);
 
-            kfree(bytecode);
-            for (int i = 0; i < argc; i++) {
-                kfree(argv[i]);
-            }
+            LOG_INFO("Process %d: Spawn process with pid %d\n", proc->pid, new_pid);
 
             result = new_pid;
             break;
@@ -259,10 +254,15 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
                 break;
             }
             
-            char filename[MAX_FILENAME];
+            char* filename = scratch_alloc(start_pos - null_pos);
+            if (!filename) {
+                result = -1;
+                break;
+            }
+
             int pos = 0;
        
-            for (int i = null_pos + 1; i < start_pos && pos < MAX_FILENAME - 1; i++) {
+            for (int i = null_pos + 1; i < start_pos; i++) {
                 char ch = proc->stack[i] & 0xFF;
                 filename[pos++] = ch;
             }
@@ -378,6 +378,7 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
                     if (processes[i].active && processes[i].pid == recipient && processes[i].blocked) {
                         processes[i].blocked = false; 
                         processes[i].wakeup_reason = 1;
+                        schedstat_wakeup(processes[i].pid, ktime_ns());
                         LOG_DEBUG("Unblocked process %d due to incoming message\n", recipient);
                         break;
                     }
@@ -397,10 +398,6 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
             }
             
             if (found_index == -1) {
-                serial_print("No messages for process ");
-                itoa(proc->pid, buffer, 10);
-                serial_print(buffer);
-                serial_print(" - blocking process\n");
                 LOG_DEBUG("Process %d: No messages - blocking\n", proc->pid);
                 proc->blocked = true;
                 result = -1;
@@ -424,7 +421,6 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
                 break;
             }
 
-            itoa(proc->pid, buffer, 10);
             LOG_DEBUG("Process %d: Message received\n", proc->pid);
             break;
         }
@@ -477,13 +473,29 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
             break;
         }
 
+        case SYS_TIME: {
+            if (proc->sp + 2 > STACK_SIZE) {
+                LOG_WARN("Process %d: Stack overflow for time\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            // Monotonic microseconds, high word first so the low word is on top
+            uint64_t us = ktime_ns() / NSEC_PER_USEC;
+            proc->stack[proc->sp] = (int32_t)(us >> 32);
+            proc->stack[proc->sp + 1] = (int32_t)(uint32_t)us;
+            proc->sp += 2;
+            break;
+        }
+
         default: {
-            itoa(syscall_id, buffer, 16);
-            LOG_WARN("Process %d: unknown syscall: 0x%s\n", proc->pid, buffer);
+            LOG_WARN("Process %d: unknown syscall: 0x%x\n", proc->pid, syscall_id);
             proc->exit_code = -1;
             proc->active = false;
         }
     }
     
+    vfs_set_fd_table(saved_fds);
+    scratch_end(scratch);
     return result;
 }
\ No newline at end of file
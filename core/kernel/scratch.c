@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#define LOG_SUBSYSTEM LOG_SUBSYS_MEM
+
+#include <core/kernel/scratch.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/log.h>
+
+// One arena for now; becomes per-CPU once there is more than one.
+typedef struct scratch_chunk {
+    struct scratch_chunk* prev;
+    size_t size;
+    size_t used;
+    uint8_t data[];
+} scratch_chunk_t;
+
+static scratch_chunk_t* scratch_head = NULL;
+
+static scratch_chunk_t* scratch_new_chunk(size_t min_size) {
+    size_t size = SCRATCH_CHUNK_SIZE;
+    while (size < min_size) {
+        size *= 2;
+    }
+
+    scratch_chunk_t* chunk = kmalloc(sizeof(scratch_chunk_t) + size);
+    if (!chunk) {
+        return NULL;
+    }
+
+    chunk->prev = scratch_head;
+    chunk->size = size;
+    chunk->used = 0;
+    scratch_head = chunk;
+    return chunk;
+}
+
+scratch_scope_t scratch_begin(void) {
+    scratch_scope_t scope;
+    scope.chunk = scratch_head;
+    scope.used = scratch_head ? scratch_head->used : 0;
+    return scope;
+}
+
+void scratch_end(scratch_scope_t scope) {
+    // Drop overflow chunks taken inside the scope, keep the one it began in
+    while (scratch_head && scratch_head != scope.chunk) {
+        scratch_chunk_t* prev = scratch_head->prev;
+        if (!prev && !scope.chunk) {
+            // First chunk ever allocated: keep it around for next time
+            break;
+        }
+        kfree(scratch_head);
+        scratch_head = prev;
+    }
+
+    if (scratch_head) {
+        scratch_head->used = (scratch_head == scope.chunk) ? scope.used : 0;
+    }
+}
+
+void* scratch_alloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+
+    if (!scratch_head || scratch_head->size - scratch_head->used < size) {
+        if (!scratch_new_chunk(size)) {
+            LOG_WARN("scratch: out of memory for %d bytes\n", (int)size);
+            return NULL;
+        }
+    }
+
+    void* ptr = scratch_head->data + scratch_head->used;
+    scratch_head->used += size;
+    return ptr;
+}
@@ -5,6 +5,7 @@
 #include <core/drivers/keyboard.h>
 #include <core/kernel/vge/fb.h>
 #include <core/kernel/mem.h>
+#include <core/kernel/log.h>
 #include <core/fs/initramfs.h>
 #include <core/fs/iso9660.h>
 #include <core/fs/vfs.h>
@@ -22,11 +23,13 @@ static void cmd_help(void) {
     kprint("\nBuilt-in commands:\n", 10);
     kprint("  help     - Show this help message\n", 7);
     kprint("  memtest  - Test memory allocation\n", 7);
-    kprint("  list     - List loaded NVM programs\n", 7);
+    kprint("  membench - Measure memcpy/memset bandwidth\n", 7);
+    kprint("  list     - List initramfs NVM programs\n", 7);
     kprint("  progs    - List userspace programs\n", 7);
     kprint("  pwd      - Print working directory\n", 7);
     kprint("  ls       - List directory contents\n", 7);
     kprint("  cat      - Display file contents\n", 7);
+    kprint("  loglevel - Show or set log levels\n", 7);
     kprint("\nISO9660 commands:\n", 10);
     kprint("  isols    - List files in ISO9660 directory\n", 7);
     kprint("  isocat   - Show ISO9660 file content\n", 7);
@@ -43,11 +46,9 @@ static void cmd_memtest(void) {
     
     void* ptr1 = allocateMemory(128);
     if (ptr1) {
-        kprint("Allocated 128 bytes at ", 7);
-        char buf[32];
-        itoa((unsigned int)(unsigned long)ptr1, buf, 16);
+        char buf[48];
+        snprintf(buf, sizeof(buf), "Allocated 128 bytes at %p\n", ptr1);
         kprint(buf, 7);
-        kprint("\n", 7);
         freeMemory(ptr1);
         kprint("Freed memory\n", 7);
     } else {
@@ -59,22 +60,21 @@ static void cmd_memtest(void) {
 static void cmd_list(void) {
     size_t count = initramfs_get_count();
     
-    kprint("\nLoaded programs: ", 7);
-    char buf[32];
-    itoa(count, buf, 10);
+    char buf[48];
+    snprintf(buf, sizeof(buf), "\nLoaded programs: %zu\n", count);
     kprint(buf, 7);
-    kprint("\n", 7);
     
     for (size_t i = 0; i < count; i++) {
         struct program* prog = initramfs_get_program(i);
         if (prog) {
-            kprint("  [", 7);
-            itoa(i, buf, 10);
+            kprint("  ", 7);
+            kprint(prog->name, 11);
+            snprintf(buf, sizeof(buf), " - %u bytes", (unsigned int)prog->size);
             kprint(buf, 7);
-            kprint("] Size: ", 7);
-            itoa(prog->size, buf, 10);
-            kprint(buf, 7);
-            kprint(" bytes\n", 7);
+            if (prog->flags & INITRAMFS_FLAG_AUTOSTART) {
+                kprint(" (autostart)", 7);
+            }
+            kprint("\n", 7);
         }
     }
     kprint("\n", 7);
@@ -142,77 +142,26 @@ static void cmd_ls(const char* args) {
         path = current_working_directory;
     }
 
-    vfs_file_t* files = vfs_get_files();
-    int dir_len = strlen(path);
-
-    char normalized_dir[64];
-    size_t i = 0;
-    while (path[i] && i < 63) {
-        normalized_dir[i] = path[i];
-        i++;
-    }
-    normalized_dir[i] = '\0';
-
-    if (dir_len > 1 && normalized_dir[dir_len - 1] == '/') {
-        normalized_dir[dir_len - 1] = '\0';
-        dir_len--;
+    vfs_dir_t dir;
+    if (vfs_opendir(path, &dir) != 0) {
+        kprint("\nNo such directory: ", 14);
+        kprint(path, 14);
+        kprint("\n\n", 14);
+        return;
     }
 
-    int found_count = 0;
     kprint("\n", 7);
 
-    for (size_t i = 0; i < 128; i++) {
-        if (!files[i].used) continue;
-
-        const char* name = files[i].name;
-        bool should_show = false;
-        const char* display_name = name;
-
-        if (dir_len == 1 && normalized_dir[0] == '/') {
-            if (name[0] == '/' && name[1] != '\0') {
-                int slash_count = 0;
-                for (int j = 1; name[j] != '\0'; j++) {
-                    if (name[j] == '/') slash_count++;
-                }
-                if (slash_count == 0) {
-                    should_show = true;
-                    display_name = name + 1;
-                }
-            }
+    vfs_file_t* entry;
+    while ((entry = vfs_readdir(&dir)) != NULL) {
+        const char* display_name = vfs_basename(entry);
+        if (entry->type == VFS_TYPE_DIR) {
+            kprint(display_name, 9);
+            kprint("/", 9);
         } else {
-            size_t name_len = strlen(name);
-
-            if (name_len > dir_len && name[dir_len] == '/') {
-                bool match = true;
-                for (size_t j = 0; j < dir_len; j++) {
-                    if (name[j] != normalized_dir[j]) {
-                        match = false;
-                        break;
-                    }
-                }
-                if (match) {
-                    size_t slash_count = 0;
-                    for (size_t j = dir_len + 1; name[j] != '\0'; j++) {
-                        if (name[j] == '/') slash_count++;
-                    }
-                    if (slash_count == 0) {
-                        should_show = true;
-                        display_name = name + dir_len + 1;
-                    }
-                }
-            }
-        }
-
-        if (should_show) {
-            found_count++;
-            if (files[i].type == VFS_TYPE_DIR) {
-                kprint(display_name, 9);
-                kprint("/", 9);
-            } else {
-                kprint(display_name, 7);
-            }
-            kprint("    ", 7);
+            kprint(display_name, 7);
         }
+        kprint("    ", 7);
     }
     kprint("\n\n", 7);
 }
@@ -244,11 +193,9 @@ static void cmd_isocat(const char* args) {
     kprint("\n", 7);
     kprint("File: ", 7);
     kprint(path, 11);
-    kprint(" (", 7);
     char buf[32];
-    itoa(size, buf, 10);
+    snprintf(buf, sizeof(buf), " (%zu bytes)\n", size);
     kprint(buf, 7);
-    kprint(" bytes)\n", 7);
     kprint("Content:\n", 7);
 
     size_t print_size = size > 1024 ? 1024 : size;
@@ -276,6 +223,29 @@ static void cmd_isocat(const char* args) {
     kprint("\n\n", 7);
 }
 
+static void cmd_loglevel(int argc, char* argv[]) {
+    if (argc == 1) {
+        char buf[256];
+        log_format_levels(buf, sizeof(buf));
+        kprint("\n", 7);
+        kprint(buf, 7);
+        kprint("\n", 7);
+        return;
+    }
+
+    const char* subsys = argc > 2 ? argv[1] : NULL;
+    const char* level = argc > 2 ? argv[2] : argv[1];
+    if (log_set_level(subsys, level) < 0) {
+        kprint("\nUsage: loglevel [subsystem|all] <fatal|error|warn|info|debug|trace>\n", 12);
+        kprint("Subsystems:", 12);
+        for (int i = 0; i < LOG_SUBSYS_COUNT; i++) {
+            kprint(" ", 12);
+            kprint(log_subsys_names[i], 12);
+        }
+        kprint("\n\n", 12);
+    }
+}
+
 static int parse_command(const char* command, char* argv[], int max_args) {
     int argc = 0;
     static char cmd_buf[MAX_COMMAND_LENGTH];
@@ -325,6 +295,10 @@ static void execute_command(const char* command) {
         cmd_help();
     } else if (strcmp(argv[0], "memtest") == 0) {
         cmd_memtest();
+    } else if (strcmp(argv[0], "membench") == 0) {
+        kprint("\n", 7);
+        mem_bench();
+        kprint("\n", 7);
     } else if (strcmp(argv[0], "list") == 0) {
         cmd_list();
     } else if (strcmp(argv[0], "progs") == 0) {
@@ -344,6 +318,8 @@ static void execute_command(const char* command) {
         } else {
             kprint("\nUsage: cat <filename>\n\n", 12);
         }
+    } else if (strcmp(argv[0], "loglevel") == 0) {
+        cmd_loglevel(argc, argv);
     } else if (strcmp(argv[0], "isols") == 0) {
         if (argc > 1) {
             cmd_isols(argv[1]);
@@ -388,14 +364,21 @@ static void execute_command(const char* command) {
             } else {
                 kprint("Error: Failed to read program file\n", 12);
             }
+        } else if (initramfs_find(argv[0])) {
+            struct program* prog = initramfs_find(argv[0]);
+            if (initramfs_open(prog)) {
+                should_delay_prompt = 1;
+                delay_ticks = 50;
+                nvm_execute((uint8_t*)prog->data, prog->size, (uint16_t[]){CAP_ALL}, 1);
+                return;
+            }
+            kprint("Error: Program image is corrupt\n", 12);
         } else if (userspace_exists(argv[0])) {
             int ret = userspace_exec(argv[0], argc, argv);
             if (ret != 0) {
-                kprint("\nProgram exited with code ", 12);
-                char buf[16];
-                itoa(ret, buf, 10);
+                char buf[48];
+                snprintf(buf, sizeof(buf), "\nProgram exited with code %d\n", ret);
                 kprint(buf, 12);
-                kprint("\n", 12);
             }
         } else {
             kprint(argv[0], 7);
@@ -430,6 +413,7 @@ void shell_run(void) {
     
     while (1) {
         nvm_scheduler_tick();
+        log_drain();
         
         if (should_delay_prompt) {
             if (delay_ticks > 0) {
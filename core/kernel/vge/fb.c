@@ -1,7 +1,10 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_FB
+
 #include <stdint.h>
 #include <lib/bootloader/limine.h>
 #include <stddef.h>
 #include <core/kernel/mem.h>
+#include <core/kernel/log.h>
 #include <core/kernel/vge/fb_render.h>
 
 #define FONT_HEIGHT 16
@@ -20,6 +23,7 @@ int init_vge_font() {
 
     if (!vfs_exists(font_path)) {
         kprint(":: Font file not found, using built-in 8x8 font.\n", 14);
+        LOG_WARN("Font %s not found, using the built-in 8x8 font\n", font_path);
         system_font_height = 8;
         for (int i = 0; i < 256; i++) {
             for (int row = 0; row < 8; row++) {
@@ -32,11 +36,13 @@ int init_vge_font() {
     int result = load_font_from_vfs(font_path, system_font);
     if (result == 0) {
         kprint(":: External font loaded (16px height).\n", 2);
+        LOG_DEBUG("Font %s loaded\n", font_path);
         system_font_height = 16;
         return 0;
     }
 
     kprint(":: Font loading failed, using built-in 8x8 font.\n", 14);
+    LOG_WARN("Font %s failed to load, using the built-in 8x8 font\n", font_path);
     system_font_height = 8;
     for (int i = 0; i < 256; i++) {
         for (int row = 0; row < 8; row++) {
@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
+#define LOG_SUBSYSTEM LOG_SUBSYS_FB
 
 #include <core/kernel/vge/fb_render.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/log.h>
 #include <lib/bootloader/limine.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -20,6 +23,8 @@ volatile struct limine_framebuffer_request fb_request = {
 static struct {
     struct limine_framebuffer *fb;
     uint32_t *fb_addr;
+    uint32_t *back;     // RAM copy of the screen, so scrolling never reads
+                        // back from the write-combining framebuffer
     uint64_t width;
     uint64_t height;
     uint64_t pitch;
@@ -183,6 +188,7 @@ void init_fb(void) {
 
     if (fb_request.response == NULL ||
         fb_request.response->framebuffer_count == 0) {
+        LOG_WARN("No framebuffer from the bootloader\n");
         return;
     }
 
@@ -203,15 +209,34 @@ void init_fb(void) {
     fb_info.cursor_y = 0;
 
     fb_info.initialized = true;
+    LOG_INFO("Framebuffer %lux%lu, pitch %lu, %d bpp\n",
+             fb_info.width, fb_info.height, fb_info.pitch, fb_info.fb->bpp);
 
     clear_screen();
 }
 
+void fb_init_backbuffer(void) {
+    init_fb();
+    if (!fb_info.initialized || fb_info.back) return;
+
+    size_t size = fb_info.pitch * fb_info.height;
+    uint32_t *back = allocateMemory(size);
+    if (!back) {
+        LOG_WARN("No memory for a %lu byte back buffer, scrolling reads the framebuffer\n", size);
+        return;
+    }
+
+    memcpy(back, fb_info.fb_addr, size);
+    fb_info.back = back;
+    LOG_DEBUG("Back buffer of %lu bytes at 0x%p\n", size, back);
+}
+
 static void put_pixel(uint32_t x, uint32_t y, uint32_t color) {
     if (x >= fb_info.width || y >= fb_info.height) return;
 
-    uint32_t *pixel = &fb_info.fb_addr[y * fb_info.pitch_pixels + x];
-    *pixel = color;
+    uint64_t index = y * fb_info.pitch_pixels + x;
+    fb_info.fb_addr[index] = color;
+    if (fb_info.back) fb_info.back[index] = color;
 }
 
 static void draw_char(uint32_t x, uint32_t y, char c, uint32_t color) {
@@ -237,6 +262,18 @@ static void draw_char(uint32_t x, uint32_t y, char c, uint32_t color) {
 void clear_screen(void) {
     init_fb();
 
+    if (fb_info.back) {
+        uint64_t total = fb_info.height * fb_info.pitch_pixels;
+        for (uint64_t i = 0; i < total; i++) {
+            fb_info.back[i] = fb_info.bg_color;
+        }
+        memcpy(fb_info.fb_addr, fb_info.back, total * 4);
+
+        fb_info.cursor_x = 0;
+        fb_info.cursor_y = 0;
+        return;
+    }
+
     for (uint32_t y = 0; y < fb_info.height; y++) {
         for (uint32_t x = 0; x < fb_info.width; x++) {
             put_pixel(x, y, fb_info.bg_color);
@@ -259,6 +296,22 @@ void newline(void) {
         uint32_t *dst = fb_info.fb_addr;
         uint64_t size = (fb_info.height - scroll_lines) * fb_info.pitch_pixels * 4;
 
+        if (fb_info.back) {
+            uint32_t *back = fb_info.back;
+            memmove(back, &back[scroll_lines * fb_info.pitch_pixels], size);
+
+            uint64_t last_line_start = (fb_info.height - scroll_lines) * fb_info.pitch_pixels;
+            for (uint64_t i = 0; i < scroll_lines * fb_info.pitch_pixels; i++) {
+                back[last_line_start + i] = fb_info.bg_color;
+            }
+
+            // One sequential pass over the framebuffer: WC bursts
+            memcpy(fb_info.fb_addr, back, fb_info.height * fb_info.pitch_pixels * 4);
+
+            fb_info.cursor_y = fb_info.height - fb_info.char_height;
+            return;
+        }
+
         for (uint64_t i = 0; i < size / 4; i++) {
             dst[i] = src[i];
         }
@@ -2,6 +2,7 @@
 #define _CPUID_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct {
     uint32_t eax;
@@ -10,6 +11,20 @@ typedef struct {
     uint32_t edx;
 } cpuid_result_t;
 
+// CPU features the kernel dispatches on. Detected once at boot by
+// cpu_features_init(), queried afterwards with cpu_has_feature().
+typedef enum {
+    CPU_FEATURE_TSC,    // CPUID.01H:EDX[4]  - time stamp counter
+    CPU_FEATURE_PGE,    // CPUID.01H:EDX[13] - global pages
+    CPU_FEATURE_PAT,    // CPUID.01H:EDX[16] - page attribute table
+    CPU_FEATURE_ERMS,   // CPUID.07H:EBX[9]  - enhanced rep movsb/stosb
+    CPU_FEATURE_FSRM,   // CPUID.07H:EDX[4]  - fast short rep movsb
+    CPU_FEATURE_INVARIANT_TSC, // CPUID.80000007H:EDX[8] - constant rate TSC
+    CPU_FEATURE_COUNT
+} cpu_feature_t;
+
 void cpuid(uint32_t leaf, uint32_t subleaf, cpuid_result_t* result);
+void cpu_features_init(void);
+bool cpu_has_feature(cpu_feature_t feature);
 
-#endif
\ No newline at end of file
+#endif
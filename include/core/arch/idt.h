@@ -1,3 +1,6 @@
+#ifndef IDT_H
+#define IDT_H
+
 #include <stdint.h>
 
 #define IDT_SIZE 256
@@ -10,4 +13,46 @@
 
 #define SYSCALL_INTERRUPT 0x80
 
-extern uint8_t inb(uint16_t port);
\ No newline at end of file
+// The legacy PIC is remapped above the CPU exceptions; every line starts
+// masked and is unmasked when a handler is registered for it.
+#define IRQ_BASE   32
+#define IRQ_COUNT  16
+#define IRQ_PIT    0
+#define IRQ_COM1   4
+
+// Layout pushed by the stubs in isr.asm
+typedef struct {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector, error;
+    uint64_t rip, cs, rflags, rsp, ss;      // Pushed by the CPU
+} interrupt_frame_t;
+
+typedef void (*irq_handler_t)(void);
+
+void idt_init(void);
+int irq_register(int irq, irq_handler_t handler);
+void irq_mask(int irq);
+void irq_unmask(int irq);
+
+static inline void interrupts_enable(void) {
+    asm volatile("sti" ::: "memory");
+}
+
+// Disable interrupts around a critical section and put them back as they were
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & (1 << 9)) {
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+extern uint8_t inb(uint16_t port);
+extern void outb(uint16_t port, uint8_t val);
+
+#endif // IDT_H
\ No newline at end of file
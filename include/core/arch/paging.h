@@ -0,0 +1,46 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define PAGE_SIZE       0x1000ULL
+#define PAGE_SIZE_2M    0x200000ULL
+
+// Page table entry bits
+#define PAGE_PRESENT    (1ULL << 0)
+#define PAGE_WRITE      (1ULL << 1)
+#define PAGE_USER       (1ULL << 2)
+#define PAGE_PWT        (1ULL << 3)
+#define PAGE_PCD        (1ULL << 4)
+#define PAGE_HUGE       (1ULL << 7)
+#define PAGE_GLOBAL     (1ULL << 8)
+#define PAGE_NX         (1ULL << 63)
+
+// Memory types, selected through the PAT layout installed by paging_init()
+#define PAGE_CACHE_WB   0
+#define PAGE_CACHE_WC   PAGE_PWT
+#define PAGE_CACHE_UC   (PAGE_PWT | PAGE_PCD)
+
+#define PAGE_KERNEL     (PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL)
+
+typedef uint64_t pml4_t;
+
+// Build kernel page tables (HHDM with 2 MB pages, write-combining
+// framebuffer, kernel image with a stack guard page) and switch to them.
+void paging_init(void);
+bool paging_is_enabled(void);
+
+pml4_t* paging_kernel_pml4(void);
+// New top-level table sharing the kernel half of the address space.
+pml4_t* paging_create_address_space(void);
+void paging_switch(pml4_t* pml4);
+
+int paging_map_page(pml4_t* pml4, uint64_t virt, uint64_t phys, uint64_t flags);
+int paging_map_range(pml4_t* pml4, uint64_t virt, uint64_t phys, size_t size, uint64_t flags);
+int paging_unmap_page(pml4_t* pml4, uint64_t virt);
+// Returns (uint64_t)-1 when virt is not mapped.
+uint64_t paging_virt_to_phys(pml4_t* pml4, uint64_t virt);
+
+#endif // PAGING_H
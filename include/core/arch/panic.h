@@ -1,8 +1,12 @@
 #ifndef PANIC_H
 #define PANIC_H
 
+#include <core/kernel/log.h>
+#include <core/kernel/vge/fb_render.h>
+
 inline static void panic(const char* message) {
     asm volatile ("cli");
+    log_flush_serial();
     kprint("KERNEL PANIC: ", 4);
     kprint(message, 4);
     kprint("\n", 4);
@@ -0,0 +1,18 @@
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// SipHash-2-4 keyed with a 128-bit secret. Used for hash tables whose keys
+// come from outside the kernel (paths, names) so bucket placement can't be
+// predicted.
+struct siphash_key
+{
+    uint64_t k0;
+    uint64_t k1;
+};
+
+uint64_t siphash24(const struct siphash_key *key, const void *data, size_t len);
+
+#endif
@@ -2,14 +2,27 @@
 #define SERIAL_H
 
 #include <core/kernel/kstd.h>
+#include <stdint.h>
 
 #define PORT 0x3f8 // COM1
 
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 115200
+#endif
+
+#define SERIAL_TX_SIZE   4096   // Power of two
+#define SERIAL_RX_SIZE   256    // Power of two
+#define SERIAL_FIFO_SIZE 16     // 16550 transmit FIFO
+
 char read_serial();
 int init_serial();
 int serial_received();
 int is_transmit_empty();
 void write_serial(char a);
 void serial_print(const char* str);
+size_t serial_write(const char* buf, size_t len);
+size_t serial_tx_free(void);
+void serial_flush(void);
+int serial_set_baud(uint32_t baud);
 
 #endif // SERIAL_H
\ No newline at end of file
@@ -3,20 +3,51 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <lib/bootloader/limine.h>
 
+// Image format written by initramfs-rebuild.rb (little-endian)
+#define INITRAMFS_MAGIC     "NVRD"
+#define INITRAMFS_VERSION   2
+#define INITRAMFS_NAME_MAX  32
+
+#define INITRAMFS_FLAG_AUTOSTART 0x1   // Started by kmain at boot
+#define INITRAMFS_FLAG_LZ4       0x2   // Stored as an LZ4 block
+
+struct initramfs_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t count;
+} __attribute__((packed));
+
+struct initramfs_entry {
+    char name[INITRAMFS_NAME_MAX];      // NUL-padded
+    uint32_t offset;                    // From the start of the image
+    uint32_t stored_size;               // Bytes in the image
+    uint32_t size;                      // Bytes once decompressed
+    uint32_t flags;
+    uint32_t checksum;                  // FNV-1a 32 of the decompressed bytes
+} __attribute__((packed));
+
+// Programs point straight into the boot module; nothing is copied at load.
+// data stays NULL for compressed programs until initramfs_open().
 struct program {
+    const char* name;
     const char* data;
     size_t size;
-    int ramfs_sector;
+    const char* stored;
+    size_t stored_size;
+    uint32_t flags;
+    uint32_t checksum;
+    int verified;           // 0 = not checked yet, 1 = ok, -1 = corrupt
 };
 
 void initramfs_load(struct limine_module_request* module_request);
 void initramfs_load_limine(volatile struct limine_module_request* module_request);
 void initramfs_load_from_memory(void* initramfs_data, size_t initramfs_size);
 struct program* initramfs_get_program(size_t index);
+struct program* initramfs_find(const char* name);
+bool initramfs_open(struct program* prog);
 size_t initramfs_get_count(void);
-int initramfs_load_to_ramfs(size_t index);
-void initramfs_list_programs(void);
 
-#endif
\ No newline at end of file
+#endif
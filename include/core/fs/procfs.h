@@ -3,11 +3,8 @@
 
 #include <core/fs/vfs.h>
 
-vfs_ssize_t procfs_cpu(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos);
-vfs_ssize_t procfs_cpuinfo(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos);
-vfs_ssize_t procfs_meminfo(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos);
-vfs_ssize_t procfs_pci(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos);
-vfs_ssize_t procfs_uptime(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos);
+// Mount /proc. Files are seq_file generators; /proc/<pid>/{stat,status,caps,
+// sched} are served for every live NVM process.
 void procfs_init(void);
 void cpuinfo_init(void);
 
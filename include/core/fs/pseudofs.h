@@ -0,0 +1,18 @@
+#ifndef PSEUDOFS_H
+#define PSEUDOFS_H
+
+#include <core/fs/vfs.h>
+
+#define PSEUDOFS_MAX_NODES 32
+
+// Mount an empty callback-node filesystem at path; nodes are added with
+// vfs_pseudo_register(), which also creates any directories on the way.
+// Used for /dev and /proc.
+int pseudofs_mount(const char* path);
+
+// For filesystems that add entries of their own to a pseudofs mount (procfs
+// serves /proc/<pid>): their ops fall back to these for everything else.
+extern const vfs_super_ops_t pseudofs_super_ops;
+int pseudofs_mount_with(const char* path, const vfs_super_ops_t* ops);
+
+#endif
@@ -7,17 +7,33 @@
 
 #define MAX_SECTORS 256
 #define SECTOR_SIZE 4096
+#define RAMFS_MAX_OBJECTS 64   // One bit each in the object map
+#define RAMFS_MAX_EXTENTS 8
+
+// Sector-backed object store. Nothing in the tree stores into it at the
+// moment: initramfs programs run straight from module memory.
+
+// Run of consecutive sectors
+typedef struct {
+    uint16_t start;
+    uint16_t count;
+} ramfs_extent_t;
 
 typedef struct {
-    char data[SECTOR_SIZE];
     size_t size;
-    bool used;
-} ramfs_sector_t;
+    int extent_count;
+    ramfs_extent_t extents[RAMFS_MAX_EXTENTS];
+} ramfs_object_t;
 
 void ramfs_init(void);
 int ramfs_write(const char* data, size_t size);
-const char* ramfs_read(int sector, size_t* size);
-void ramfs_delete(int sector);
-size_t ramfs_get_size(int sector);
+int ramfs_write_at(int object, size_t pos, const char* data, size_t size);
+size_t ramfs_read_at(int object, size_t pos, char* buf, size_t count);
+// Contiguous view of the whole object; NULL if it spans several extents
+const char* ramfs_read(int object, size_t* size);
+int ramfs_resize(int object, size_t size);
+void ramfs_delete(int object);
+size_t ramfs_get_size(int object);
+size_t ramfs_free_sectors(void);
 
-#endif
\ No newline at end of file
+#endif
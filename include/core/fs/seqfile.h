@@ -0,0 +1,43 @@
+#ifndef SEQFILE_H
+#define SEQFILE_H
+
+#include <core/fs/vfs.h>
+#include <stdbool.h>
+
+// Generated files in the style of Linux's seq_file. A show function prints
+// the whole file with seq_printf()/seq_puts(); every read runs it again and
+// only the bytes in [*pos, *pos + count) are kept, written straight into
+// the reader's buffer. Nothing is cached between reads, so a read from
+// offset 0 (any fresh open) always sees current contents. A reader that
+// needs one consistent snapshot should read the file in a single call.
+typedef struct {
+    char* buf;                  // Reader's buffer
+    size_t count;
+    vfs_off_t start;            // File offset of buf[0]
+    vfs_off_t pos;              // File offset of the next generated byte
+    bool full;                  // buf is full, the rest can be skipped
+} seq_file_t;
+
+typedef void (*seq_show_t)(seq_file_t* m, void* data);
+
+typedef struct {
+    seq_show_t show;
+    void* data;
+} seq_source_t;
+
+void seq_write(seq_file_t* m, const char* data, size_t len);
+void seq_puts(seq_file_t* m, const char* str);
+void seq_printf(seq_file_t* m, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Long generators can stop once this is true; the output is not needed
+static inline bool seq_full(const seq_file_t* m) {
+    return m->full;
+}
+
+vfs_ssize_t seq_read(void* buf, size_t count, vfs_off_t* pos, seq_show_t show, void* data);
+// Read callback for nodes whose dev_data is a seq_source_t
+vfs_ssize_t seq_file_read(vfs_file_t* file, void* buf, size_t count, vfs_off_t* pos);
+// Register a read-only generated file; source must outlive the node
+int seq_register(const char* path, const seq_source_t* source);
+
+#endif
@@ -5,10 +5,13 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define MAX_FILES 256
-#define MAX_HANDLES 64
+#define MAX_FILES 1024
+#define MAX_MOUNTS 8
+#define MAX_HANDLES 256  // Open-file objects shared by all fd tables
+#define VFS_MAX_FDS 64   // Per-table descriptors, one bit each in the bitmap
 #define MAX_FILENAME 256
-#define MAX_FILE_SIZE 65536
+#define MAX_FILE_SIZE (16 * 1024 * 1024)
+#define VFS_PAGE_SIZE 4096
 
 #define VFS_READ   0x01
 #define VFS_WRITE  0x02
@@ -26,10 +29,12 @@
 #define DEV_STDIN_FD  1003
 #define DEV_STDOUT_FD 1004
 #define DEV_STDERR_FD 1005
+#define VFS_DEV_FDS   6   // DEV_NULL_FD..DEV_STDERR_FD
 
 #define ENOSPC  28
 #define EACCES  13
 #define ENOTTY  25
+#define EINVAL  22
 #define EBADF   9
 #define ENOSYS  38
 
@@ -40,6 +45,7 @@ typedef enum {
 } vfs_file_type_t;
 
 typedef struct vfs_file_t vfs_file_t;
+typedef struct vfs_mount_t vfs_mount_t;
 
 typedef long vfs_off_t;
 typedef long vfs_ssize_t;
@@ -49,45 +55,131 @@ typedef vfs_ssize_t (*vfs_dev_write_t)(vfs_file_t* file, const void* buf, size_t
 typedef vfs_off_t (*vfs_dev_seek_t)(vfs_file_t* file, vfs_off_t offset, int whence, vfs_off_t* pos);
 typedef int (*vfs_dev_ioctl_t)(vfs_file_t* file, unsigned long request, void* arg);
 
+// Per-file operations. A NULL read/write/ioctl fails the call; a NULL seek
+// gets the default position arithmetic.
 typedef struct {
     vfs_dev_read_t read;
     vfs_dev_write_t write;
     vfs_dev_seek_t seek;
     vfs_dev_ioctl_t ioctl;
-} vfs_device_ops_t;
+} vfs_inode_ops_t;
+
+typedef struct {
+    vfs_file_type_t type;
+    size_t size;
+} vfs_stat_t;
+
+// Per-filesystem operations. Paths are relative to the mount point and
+// start with '/'; the mount root itself is "/".
+typedef struct {
+    vfs_file_t* (*lookup)(vfs_mount_t* mount, const char* path);
+    // Next entry of dir, or NULL; *cookie starts at 0 and is private to the fs
+    vfs_file_t* (*readdir)(vfs_mount_t* mount, vfs_file_t* dir, long* cookie);
+    int (*stat)(vfs_mount_t* mount, vfs_file_t* file, vfs_stat_t* st);
+    // Optional: create or update a callback node (used by vfs_pseudo_register)
+    vfs_file_t* (*mknod)(vfs_mount_t* mount, const char* path,
+                         const vfs_inode_ops_t* ops, void* dev_data);
+} vfs_super_ops_t;
+
+struct vfs_mount_t {
+    bool used;
+    char path[MAX_FILENAME];
+    int path_len;
+    const vfs_super_ops_t* ops;
+    void* data;                 // Superblock private to the filesystem
+};
+
+// Storage backend for regular files whose bytes live outside the VFS
+// (e.g. in a boot module). Reads are clamped to the file size by the VFS;
+// the first write or resize copies the contents into VFS pages.
+typedef struct {
+    vfs_ssize_t (*read)(vfs_file_t* file, void* buf, size_t count, vfs_off_t pos);
+    const char* (*map)(vfs_file_t* file);   // Contiguous view, or NULL
+} vfs_backend_ops_t;
+
+// Fills a lazily created directory; runs once, the first time a path under
+// it is looked up or it is listed
+typedef void (*vfs_dir_populate_t)(vfs_file_t* dir);
 
 struct vfs_file_t {
     char name[MAX_FILENAME];
     bool used;
     size_t size;
     vfs_file_type_t type;
-    char data[MAX_FILE_SIZE];
 
-    vfs_device_ops_t ops;
+    // Contents in VFS_PAGE_SIZE pages; a NULL page is a hole that reads as zeros
+    char** pages;
+    size_t page_slots;
+    char* flat;                 // Contiguous copy handed out by vfs_read()
+    const vfs_backend_ops_t* backend;   // NULL for page-backed files
+    vfs_dir_populate_t populate;        // Pending lazy directory fill
+    void* backend_data;                 // Private data for backend/populate
+
+    const vfs_inode_ops_t* iops;        // Operations used by the fd calls
+    vfs_inode_ops_t ops;                // Storage for callback nodes' iops
     void* dev_data;
+    int open_handles;                   // Handles whose file is this node
+
+    // Directory tree, as indices into the file table (-1 = none)
+    int parent;
+    int first_child;
+    int last_child;
+    int prev_sibling;
+    int next_sibling;
 };
 
+// Cursor for vfs_readdir
+typedef struct {
+    vfs_mount_t* mount;
+    vfs_file_t* dir;
+    long cookie;
+} vfs_dir_t;
+
+// Open-file object: shared by every descriptor that refers to it
 typedef struct {
     bool used;
-    int fd;
+    int refs;
     vfs_file_t* file;
     vfs_off_t position;
     int flags;
 } vfs_handle_t;
 
+// Descriptor table; fds index it directly. The device fds are per-table
+// aliases of the global device handles.
+typedef struct {
+    vfs_handle_t* fds[VFS_MAX_FDS];
+    vfs_handle_t* dev[VFS_DEV_FDS];
+    uint64_t used;
+} vfs_fd_table_t;
+
 void vfs_init(void);
+int vfs_mount(const char* path, const vfs_super_ops_t* ops, void* data);
+vfs_fd_table_t* vfs_fd_table_create(void);
+void vfs_fd_table_destroy(vfs_fd_table_t* table);
+vfs_fd_table_t* vfs_set_fd_table(vfs_fd_table_t* table);
 int vfs_mkdir(const char* dirname);
+int vfs_mkdir_lazy(const char* dirname, vfs_dir_populate_t populate, void* data);
 int vfs_create(const char* filename, const char* data, size_t size);
+int vfs_create_backed(const char* filename, const vfs_backend_ops_t* backend,
+                      void* backend_data, size_t size);
 int vfs_pseudo_register(const char* filename, vfs_dev_read_t read_fn, vfs_dev_write_t write_fn,
               vfs_dev_seek_t seek_fn, vfs_dev_ioctl_t ioctl_fn, void* dev_data);
+// The returned buffer stays valid until the file is resized or deleted
 const char* vfs_read(const char* filename, size_t* size);
+int vfs_truncate(const char* filename, size_t size);
 int vfs_open(const char* filename, int flags);
 vfs_ssize_t vfs_readfd(int fd, void* buf, size_t count);
 vfs_ssize_t vfs_writefd(int fd, const void* buf, size_t count);
+vfs_ssize_t vfs_append(const char* filename, const void* data, size_t size);
 int vfs_close(int fd);
 vfs_off_t vfs_seek(int fd, vfs_off_t offset, int whence);
 int vfs_delete(const char* filename);
+int vfs_rename(const char* oldpath, const char* newpath);
+int vfs_opendir(const char* path, vfs_dir_t* dir);
+vfs_file_t* vfs_readdir(vfs_dir_t* dir);
+const char* vfs_basename(const vfs_file_t* file);
 int vfs_ioctl(int fd, unsigned long request, void* arg);
+int vfs_stat(const char* path, vfs_stat_t* st);
 bool vfs_exists(const char* filename);
 bool vfs_is_dir(const char* path);
 bool vfs_is_device(const char* path);
@@ -1,8 +1,10 @@
 #ifndef _KSTD_H
 #define _KSTD_H
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 void reverse(char* str, int length);
 char* itoa(int num, char* str, int base);
@@ -14,5 +16,27 @@ char* strchr(const char* str, int c);
 char* strstr(const char* haystack, const char* needle);
 void strcat_safe(char *dest, const char *src, size_t max_len);
 
+// printf-style formatting: flags -+ #0, width and precision (also '*'),
+// hh/h/l/ll/z length modifiers, d i u x X o c s p and %%. Output is always
+// NUL-terminated; the return value is the length the full output needs.
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args)
+    __attribute__((format(printf, 3, 0)));
+int snprintf(char* buf, size_t size, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// The same engine with arguments supplied by a callback, for callers that
+// keep them somewhere other than a va_list (the binary log ring). next_arg
+// returns ints sign-extended and pointers/strings as addresses.
+#define FMT_ARG_INT   0         // int, also %c and '*' widths
+#define FMT_ARG_LONG  1         // 64-bit: l, ll, z, j, t
+#define FMT_ARG_PTR   2         // %p
+#define FMT_ARG_STR   3         // %s; must stay valid until the next fetch
+
+typedef uint64_t (*fmt_arg_t)(void* ctx, int kind);
+int format_with(char* buf, size_t size, const char* fmt, fmt_arg_t next_arg, void* ctx);
+// Store up to max argument kinds in the order fmt consumes them; returns
+// how many arguments fmt consumes in total
+int format_arg_kinds(const char* fmt, uint8_t* kinds, int max);
+
 
 #endif // _KSTD_H
@@ -0,0 +1,30 @@
+#ifndef KTIME_H
+#define KTIME_H
+
+#include <stdint.h>
+
+#define NSEC_PER_SEC    1000000000ULL
+#define NSEC_PER_MSEC   1000000ULL
+#define NSEC_PER_USEC   1000ULL
+
+typedef enum {
+    KTIME_SOURCE_NONE,
+    KTIME_SOURCE_TSC,       // Calibrated against the HPET or PIT channel 2
+    KTIME_SOURCE_HPET,      // TSC missing or not invariant
+    KTIME_SOURCE_PIT,       // 1 kHz IRQ 0 ticks, last resort
+} ktime_source_t;
+
+// Pick and calibrate the monotonic clock. rsdp is the ACPI RSDP from the
+// bootloader (may be NULL); it is only used to look for an HPET. Needs
+// paging and the IDT to be up.
+void ktime_init(void* rsdp);
+
+// Nanoseconds since ktime_init(); 0 before it. Never goes backwards.
+uint64_t ktime_ns(void);
+
+ktime_source_t ktime_source(void);
+const char* ktime_source_name(void);
+// 0 unless the TSC was calibrated
+uint64_t ktime_tsc_hz(void);
+
+#endif // KTIME_H
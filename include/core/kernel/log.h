@@ -15,171 +15,89 @@
 #define LOG_LEVEL_DEBUG   4
 #define LOG_LEVEL_TRACE   5
 
+// Compile-time ceiling; calls above it are compiled out entirely
 #ifndef CURRENT_LOG_LEVEL
 #define CURRENT_LOG_LEVEL LOG_LEVEL_TRACE
 #endif
 
-#define MAX_LOG_SIZE 4000
-
-static char log_buffer[MAX_LOG_SIZE];
-static size_t log_size = 0;
-
-static inline void syslog_print(const char* message) {
-    if (!message) return;
-    
-    int i = 0;
-    while (message[i] != '\0' && log_size < MAX_LOG_SIZE - 1) {
-        log_buffer[log_size++] = message[i++];
-    }
-    log_buffer[log_size] = '\0';
-    
-    vfs_create("/var/log/system.log", log_buffer, log_size);
-}
-
-static inline char* utoa_hex(uintptr_t num, char* str) {
-    int i = 0;
-    
-    if (num == 0) {
-        str[i++] = '0';
-        str[i] = '\0';
-        return str;
-    }
-    
-    while (num != 0) {
-        int rem = num % 16;
-        str[i++] = (rem > 9) ? (rem - 10) + 'A' : rem + '0';
-        num /= 16;
-    }
-    
-    str[i] = '\0';
-    reverse(str, i);
-    return str;
-}
-
-static inline void log_format_basic(const char* level, const char* format, ...) {
-    char buffer[256];
-    char temp_buf[32];
-    int buf_pos = 0;
-    
-    buffer[buf_pos++] = '[';
-    const char* l = level;
-    while (*l) {
-        buffer[buf_pos++] = *l++;
-    }
-    buffer[buf_pos++] = ']';
-    buffer[buf_pos++] = ' ';
-
-    va_list args;
-    va_start(args, format);
-    
-    const char* fmt = format;
-    while (*fmt && buf_pos < 250) {
-        if (*fmt == '%' && *(fmt + 1) == 'd') {
-            int value = va_arg(args, int);
-            itoa(value, temp_buf, 10);
-            
-            char* n = temp_buf;
-            while (*n) {
-                buffer[buf_pos++] = *n++;
-            }
-            
-            fmt += 2;
-        } else if (*fmt == '%' && *(fmt + 1) == 'u') {
-            unsigned int value = va_arg(args, unsigned int);
-            itoa((int)value, temp_buf, 10);
-            
-            char* n = temp_buf;
-            while (*n) {
-                buffer[buf_pos++] = *n++;
-            }
-            
-            fmt += 2;
-        } else if (*fmt == '%' && *(fmt + 1) == 'x') {
-            unsigned int value = va_arg(args, unsigned int);
-            itoa((int)value, temp_buf, 16);
-            
-            char* n = temp_buf;
-            while (*n) {
-                buffer[buf_pos++] = *n++;
-            }
-            
-            fmt += 2;
-        } else if (*fmt == '%' && *(fmt + 1) == 'X') {
-            unsigned int value = va_arg(args, unsigned int);
-            utoa_hex(value, temp_buf); 
-            
-            char* n = temp_buf;
-            while (*n) {
-                buffer[buf_pos++] = *n++;
-            }
-            
-            fmt += 2;
-        } else if (*fmt == '%' && *(fmt + 1) == 's') {
-            const char* str = va_arg(args, const char*);
-            while (*str) {
-                buffer[buf_pos++] = *str++;
-            }
-            
-            fmt += 2;
-        } else if (*fmt == '%' && *(fmt + 1) == 'c') {
-            char c = (char)va_arg(args, int);
-            buffer[buf_pos++] = c;
-            
-            fmt += 2;
-        } else if (*fmt == '%' && *(fmt + 1) == 'p') {
-            void* ptr = va_arg(args, void*);
-            buffer[buf_pos++] = '0';
-            buffer[buf_pos++] = 'x';
-
-            uintptr_t addr = (uintptr_t)ptr;
-            utoa_hex(addr, temp_buf);
-            
-            int len = 0;
-            while (temp_buf[len]) len++;
-     
-            for (int i = len; i < 8; i++) {
-                buffer[buf_pos++] = '0';
-            }
-            
-            char* n = temp_buf;
-            while (*n) {
-                buffer[buf_pos++] = *n++;
-            }
-            
-            fmt += 2;
-        } else if (*fmt == '%' && *(fmt + 1) == '%') {
-            buffer[buf_pos++] = '%';
-            fmt += 2;
-        } else {
-            buffer[buf_pos++] = *fmt++;
-        }
-    }
-    
-    va_end(args);
-    
-    buffer[buf_pos] = '\0';
-    serial_print(buffer);
-    syslog_print(buffer);
-}
-
-static inline void syslog_init(void) {
-    log_buffer[0] = '\0';
-    log_size = 0;
-    
-    const char* init_msg = "=== NovariaOS System Log ===\n";
-    int i = 0;
-    while (init_msg[i] != '\0' && log_size < MAX_LOG_SIZE - 1) {
-        log_buffer[log_size++] = init_msg[i++];
-    }
-    log_buffer[log_size] = '\0';
-    vfs_create("/var/log/system.log", log_buffer, log_size);
-}
-
-#define LOG_FATAL(...) do { if (LOG_LEVEL_FATAL <= CURRENT_LOG_LEVEL) log_format_basic("FATAL", __VA_ARGS__); } while(0)
-#define LOG_ERROR(...) do { if (LOG_LEVEL_ERROR <= CURRENT_LOG_LEVEL) log_format_basic("ERROR", __VA_ARGS__); } while(0)
-#define LOG_WARN(...)  do { if (LOG_LEVEL_WARN <= CURRENT_LOG_LEVEL)  log_format_basic("WARN", __VA_ARGS__); } while(0)
-#define LOG_INFO(...)  do { if (LOG_LEVEL_INFO <= CURRENT_LOG_LEVEL)  log_format_basic("INFO", __VA_ARGS__); } while(0)
-#define LOG_DEBUG(...) do { if (LOG_LEVEL_DEBUG <= CURRENT_LOG_LEVEL) log_format_basic("DEBUG", __VA_ARGS__); } while(0)
-#define LOG_TRACE(...) do { if (LOG_LEVEL_TRACE <= CURRENT_LOG_LEVEL) log_format_basic("TRACE", __VA_ARGS__); } while(0)
+// Run-time levels are kept per subsystem. A source file picks its
+// subsystem by defining LOG_SUBSYSTEM before including this header.
+#define LOG_SUBSYS_CORE      0
+#define LOG_SUBSYS_BOOT      1
+#define LOG_SUBSYS_NVM       2
+#define LOG_SUBSYS_SYSCALLS  3
+#define LOG_SUBSYS_VFS       4
+#define LOG_SUBSYS_MEM       5
+#define LOG_SUBSYS_FB        6
+#define LOG_SUBSYS_COUNT     7
+
+#ifndef LOG_SUBSYSTEM
+#define LOG_SUBSYSTEM LOG_SUBSYS_CORE
+#endif
+
+#ifndef LOG_DEFAULT_LEVEL
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_TRACE
+#endif
+
+#define LOG_SYSCTL_PATH "/proc/sys/log"
+
+#define SYSLOG_PATH "/var/log/system.log"
+
+// Records go into a fixed ring that overwrites the oldest entries. Logging
+// only copies the call site and its raw arguments into the ring; text is
+// produced when serial, the syslog file or /dev/kmsg consume a record.
+#define LOG_RING_SLOTS  256     // Power of two
+#define LOG_RECORD_MAX  256     // Bytes of payload per record, including the NUL
+#define LOG_DRAIN_BATCH 32      // Records handled per log_drain() call
+#define LOG_MAX_ARGS    8       // Arguments per format string that get captured
+
+// One per LOG_* call site. The format is parsed into argument types the
+// first time the site fires; the site's address then identifies the format.
+typedef struct {
+    const char* format;
+    uint8_t level;
+    int8_t nargs;               // -1 until the format has been parsed
+    uint8_t types[LOG_MAX_ARGS];    // FMT_ARG_* kinds, see kstd.h
+} log_site_t;
+
+typedef struct {
+    uint64_t seq;               // Sequence number + 1 once published, 0 while written
+    const log_site_t* site;     // NULL for plain text records
+    uint8_t level;
+    uint16_t len;               // Bytes used in the payload
+    union {
+        char text[LOG_RECORD_MAX];
+        uint64_t args[LOG_RECORD_MAX / sizeof(uint64_t)];  // Strings follow the args
+    };
+} log_record_t;
+
+extern uint8_t log_levels[LOG_SUBSYS_COUNT];
+extern const char* const log_subsys_names[LOG_SUBSYS_COUNT];
+
+void log_write(int level, const char* text, size_t len);
+void log_binary(log_site_t* site, ...);
+size_t log_render(const log_record_t* rec, char* out);
+int log_set_level(const char* subsys, const char* level);
+void log_parse_cmdline(const char* cmdline);
+size_t log_format_levels(char* buf, size_t size);
+void log_drain(void);
+void log_flush(void);
+void log_flush_serial(void);
+void syslog_init(void);
+
+// The run-time check is one load of the subsystem's level byte and a compare
+#define LOG_AT(lvl, fmt, ...) do { \
+    if (lvl <= CURRENT_LOG_LEVEL && lvl <= log_levels[LOG_SUBSYSTEM]) { \
+        static log_site_t log_site_ = { fmt, lvl, -1, {0} }; \
+        log_binary(&log_site_, ##__VA_ARGS__); \
+    } \
+} while(0)
+
+#define LOG_FATAL(...) LOG_AT(LOG_LEVEL_FATAL, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
 
 #endif // LOG_H
\ No newline at end of file
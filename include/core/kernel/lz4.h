@@ -0,0 +1,10 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+
+// Decode one raw LZ4 block (no frame header) into dst. Returns the number
+// of bytes produced, or -1 if src is malformed or does not fit in dst.
+long lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_len);
+
+#endif
@@ -2,6 +2,7 @@
 #define MEM_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <core/kernel/kstd.h>
 #include <core/drivers/serial.h>
@@ -9,12 +10,21 @@
 extern void initializeMemoryManager(void);
 extern void* memcpy(void* dest, const void* src, size_t n);
 extern void* memset(void* s, int c, size_t n);
+extern void* memmove(void* dest, const void* src, size_t n);
+extern int memcmp(const void* s1, const void* s2, size_t n);
+extern void* memchr(const void* s, int c, size_t n);
+extern void selectMemoryRoutines(void);
 extern void* allocateMemory(size_t size);
 extern void freeMemory(void* ptr);
 extern void mm_test();
+extern void mem_bench(void);
 extern size_t getMemTotal(void);
 extern size_t getMemFree(void);
 extern size_t getMemAvailable(void);
+extern void formatMemorySize(size_t size, char* buffer);   // buffer holds 32 bytes
+extern void* physicalToVirtual(uint64_t physical);
+extern uint64_t virtualToPhysical(void* virtual);
+extern struct limine_memmap_response* getMemoryMap(void);
 
 // Aliases for convenience
 #define kmalloc allocateMemory
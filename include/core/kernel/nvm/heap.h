@@ -0,0 +1,36 @@
+#ifndef _NVM_HEAP_H
+#define _NVM_HEAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NVM_HEAP_INITIAL  4096          // First arena size, bytes
+#define NVM_HEAP_MAX      (1024 * 1024) // Arena never grows past this
+
+struct nvm_block;
+
+// Per-process linear memory. Allocations are offsets into one arena taken
+// from the kernel heap in bulk; the whole arena goes back with one kfree.
+// Block bookkeeping lives in a separate table the bytecode cannot address.
+typedef struct {
+    uint8_t* base;
+    uint32_t size;
+    struct nvm_block* blocks;   // Sorted by offset, covering [0, size)
+    uint32_t count;
+    uint32_t capacity;
+} nvm_heap_t;
+
+void nvm_heap_init(nvm_heap_t* heap);
+void nvm_heap_release(nvm_heap_t* heap);
+
+// Returns the offset of a block of at least size bytes, or -1.
+int32_t nvm_heap_alloc(nvm_heap_t* heap, int32_t size);
+bool nvm_heap_free(nvm_heap_t* heap, int32_t offset);
+
+// Bounds check for an access of len bytes at offset.
+bool nvm_heap_check(const nvm_heap_t* heap, int32_t offset, int32_t len);
+// Stricter check for block operations: the range must lie inside one
+// allocated block.
+bool nvm_heap_check_block(const nvm_heap_t* heap, int32_t offset, int32_t len);
+
+#endif
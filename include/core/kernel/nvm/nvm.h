@@ -1,5 +1,7 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include <core/kernel/nvm/heap.h>
+#include <core/fs/vfs.h>
 
 #ifndef _NVM_H
 #define _NVM_H
@@ -10,8 +12,13 @@
 #define STACK_SIZE 512
 #define MAX_LOCALS 512
 
+// Address spaces for the block memory opcodes
+#define NVM_SPACE_LOCALS 0
+#define NVM_SPACE_HEAP   1
+
 typedef struct {
     uint8_t* bytecode;          // Bytecode pointer
+    bool owns_bytecode;         // Bytecode is kfree'd when the process is reaped
     int32_t ip;                 // Instruction Pointer
     int32_t stack[STACK_SIZE];  // Data stack
     int32_t sp;                 // Stack Pointer (changed to 32-bit)
@@ -20,6 +27,8 @@ typedef struct {
     int32_t exit_code;          // Exit code
 
     int32_t locals[MAX_LOCALS]; // Local variables
+    nvm_heap_t heap;            // Linear memory for ALLOC/LOAD8../STORE8..
+    vfs_fd_table_t* fd_table;   // Created on first syscall
 
     // CAPS
     uint16_t capabilities[MAX_CAPS];  // List of caps
@@ -29,6 +38,10 @@ typedef struct {
     // Message system
     bool blocked;           // Process blocked waiting for message
     int8_t wakeup_reason;   // Reason for wakeup
+
+    // Accounting, reset when the slot is reused
+    uint64_t instructions;  // Instructions executed
+    uint64_t cpu_ns;        // Time spent running its slices
 } nvm_process_t;
 
 extern nvm_process_t processes[MAX_PROCESSES];
@@ -41,6 +54,7 @@ int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[]
 int nvm_create_process_with_stack(uint8_t* bytecode, uint32_t size,  uint16_t initial_caps[], uint8_t caps_count,  int32_t* initial_stack_values, uint16_t stack_count);
 void nvm_scheduler_tick();
 bool nvm_is_process_active(uint8_t pid);
+vfs_fd_table_t* nvm_fd_table(nvm_process_t* proc);
 int32_t nvm_get_exit_code(uint8_t pid);
 
 #endif
\ No newline at end of file
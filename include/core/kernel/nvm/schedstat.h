@@ -0,0 +1,46 @@
+#ifndef SCHEDSTAT_H
+#define SCHEDSTAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <core/kernel/nvm/nvm.h>
+#include <core/fs/seqfile.h>
+
+// Bucket i counts values in [2^i, 2^(i+1)) ns; bucket 0 also takes 0 and
+// the last one everything above it
+#define SCHEDSTAT_BUCKETS 32
+// pids are a uint8_t, so only the first 256 slots ever run
+#define SCHEDSTAT_PIDS    256
+
+typedef struct {
+    uint32_t buckets[SCHEDSTAT_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} sched_hist_t;
+
+// Per process and global. Kept out of nvm_process_t so the process table
+// does not grow by a histogram set per slot.
+typedef struct {
+    sched_hist_t wakeup;        // SYS_MSG_SEND unblock -> first run
+    sched_hist_t runqueue;      // Start or end of a full slice -> next run
+    sched_hist_t slice;         // Time spent running per slice
+    uint64_t switches;          // Slices that started with another process
+    uint64_t voluntary;         // Slices that ended by blocking
+    uint64_t involuntary;       // Slices that ran out while still runnable
+} sched_stats_t;
+
+// A new process took pid at now: its statistics start over
+void schedstat_new(uint8_t pid, uint64_t now);
+// Blocked process pid was made runnable by a message at now
+void schedstat_wakeup(uint8_t pid, uint64_t now);
+// The scheduler starts a slice of proc at now
+void schedstat_run(nvm_process_t* proc, uint64_t now);
+// The slice that schedstat_run() started ended at end
+void schedstat_stop(nvm_process_t* proc, uint64_t start, uint64_t end);
+
+void schedstat_clear(void);
+// pid < 0 prints the global statistics
+void schedstat_show(seq_file_t* m, int pid);
+
+#endif // SCHEDSTAT_H
@@ -18,5 +18,6 @@
 #define SYS_PORT_IN_BYTE    0x0C
 #define SYS_PORT_OUT_BYTE   0x0D
 #define SYS_PRINT           0x0E
+#define SYS_TIME            0x0F
 
 #endif
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <stddef.h>
+
+// Bump allocator for short-lived kernel buffers. Everything allocated after
+// scratch_begin() is released at once by the matching scratch_end().
+typedef struct {
+    void* chunk;
+    size_t used;
+} scratch_scope_t;
+
+#define SCRATCH_CHUNK_SIZE (64 * 1024)
+
+scratch_scope_t scratch_begin(void);
+void scratch_end(scratch_scope_t scope);
+void* scratch_alloc(size_t size);
+
+#endif
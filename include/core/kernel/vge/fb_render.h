@@ -8,6 +8,7 @@ extern const uint8_t builtin_font[256][8];
 
 // Framebuffer rendering functions
 void init_fb(void);
+void fb_init_backbuffer(void);
 void clear_screen(void);
 void newline(void);
 void fb_putchar(char c, int color);
@@ -1,34 +1,145 @@
 #!/usr/bin/env ruby
 require 'fileutils'
 
+# Image layout (little-endian):
+#   header  "NVRD", u16 version, u16 entry count
+#   entries name[32] (NUL-padded), u32 offset, u32 stored size, u32 size,
+#           u32 flags, u32 FNV-1a checksum of the uncompressed program
+#   data    each program, starting on a 16-byte boundary; LZ4 block format
+#           when FLAG_LZ4 is set
+MAGIC = 'NVRD'
+VERSION = 2
+HEADER_SIZE = 8
+ENTRY_SIZE = 52
+NAME_MAX = 31
+DATA_ALIGN = 16
+FLAG_AUTOSTART = 0x1
+FLAG_LZ4 = 0x2
+
+LZ4_MIN_MATCH = 4
+LZ4_LAST_LITERALS = 5   # The block must end with at least this many literals
+LZ4_MATCH_LIMIT = 12    # and the last match must start this far from the end
+LZ4_MAX_OFFSET = 65535
+
+def fnv1a32(data)
+  hash = 0x811c9dc5
+  data.each_byte { |b| hash = ((hash ^ b) * 0x01000193) & 0xffffffff }
+  hash
+end
+
+def lz4_length(out, n)
+  while n >= 255
+    out << 255
+    n -= 255
+  end
+  out << n
+end
+
+def lz4_sequence(out, src, lit_start, lit_end, offset = nil, match_len = 0)
+  lit_len = lit_end - lit_start
+  ml = offset ? match_len - LZ4_MIN_MATCH : 0
+  out << (([lit_len, 15].min << 4) | [ml, 15].min)
+  lz4_length(out, lit_len - 15) if lit_len >= 15
+  out.concat(src.byteslice(lit_start, lit_len).bytes)
+  return unless offset
+
+  out << (offset & 0xff) << (offset >> 8)
+  lz4_length(out, ml - 15) if ml >= 15
+end
+
+# Greedy LZ4 block compressor: one hash probe per position
+def lz4_compress(src)
+  out = []
+  table = {}
+  n = src.bytesize
+  anchor = 0
+  i = 0
+
+  while i < n - LZ4_MATCH_LIMIT
+    key = src.byteslice(i, LZ4_MIN_MATCH)
+    cand = table[key]
+    table[key] = i
+
+    if cand && i - cand <= LZ4_MAX_OFFSET
+      len = LZ4_MIN_MATCH
+      max = n - LZ4_LAST_LITERALS - i
+      len += 1 while len < max && src.getbyte(cand + len) == src.getbyte(i + len)
+
+      lz4_sequence(out, src, anchor, i, i - cand, len)
+      i += len
+      anchor = i
+    else
+      i += 1
+    end
+  end
+
+  lz4_sequence(out, src, anchor, n)
+  out.pack('C*')
+end
+
+def align(value, to)
+  (value + to - 1) / to * to
+end
+
+# Optional <app_dir>/autostart: one program name per line, started at boot
+def read_autostart(app_dir)
+  path = File.join(app_dir, "autostart")
+  return [] unless File.exist?(path)
+  File.readlines(path).map(&:strip).reject { |l| l.empty? || l.start_with?('#') }
+end
+
 def create_initramfs(app_dir, output_file)
   bin_files = Dir.glob(File.join(app_dir, "*.bin")).sort
   puts "Found #{bin_files.size} .bin files in #{app_dir}"
-  
-  total_size = 0
+
+  autostart = read_autostart(app_dir)
+  offset = align(HEADER_SIZE + ENTRY_SIZE * bin_files.size, DATA_ALIGN)
+
+  entries = bin_files.map do |bin_file|
+    name = File.basename(bin_file, ".bin")
+    if name.bytesize > NAME_MAX
+      puts "Error: program name '#{name}' is longer than #{NAME_MAX} bytes"
+      exit 1
+    end
+
+    data = File.binread(bin_file)
+    flags = autostart.include?(name) ? FLAG_AUTOSTART : 0
+
+    # Keep the compressed form only when it is actually smaller
+    stored = data
+    packed = lz4_compress(data)
+    if packed.bytesize < data.bytesize
+      stored = packed
+      flags |= FLAG_LZ4
+    end
+
+    entry = { name: name, data: data, stored: stored, offset: offset, flags: flags }
+    offset = align(offset + stored.bytesize, DATA_ALIGN)
+
+    notes = []
+    notes << "lz4 #{stored.bytesize} bytes" if flags & FLAG_LZ4 != 0
+    notes << "autostart" if flags & FLAG_AUTOSTART != 0
+    puts "Adding #{name} (#{data.bytesize} bytes#{notes.map { |x| ', ' + x }.join})"
+    entry
+  end
+
+  (autostart - entries.map { |e| e[:name] }).each do |missing|
+    puts "Warning: autostart program '#{missing}' not found"
+  end
+
   File.open(output_file, 'wb') do |out|
-    bin_files.each do |bin_file|
-      data = File.binread(bin_file)
-      size = data.bytesize
-      
-      puts "Adding #{File.basename(bin_file)} (#{size} bytes)"
-      
-      out.write([size].pack('N'))
-      
-      out.write(data)
-      
-      total_size += 4 + size
-      
-      padding = (4 - (size % 4)) % 4
-      if padding > 0
-        out.write("\0" * padding)
-        total_size += padding
-        puts "  Added #{padding} bytes padding"
-      end
+    out.write([MAGIC, VERSION, entries.size].pack('a4vv'))
+    entries.each do |e|
+      out.write([e[:name], e[:offset], e[:stored].bytesize, e[:data].bytesize,
+                 e[:flags], fnv1a32(e[:data])].pack('a32VVVVV'))
+    end
+    entries.each do |e|
+      out.write("\0" * (e[:offset] - out.pos))
+      out.write(e[:stored])
     end
   end
-  
-  puts "Created initramfs: #{output_file} (#{File.size(output_file)} bytes, total with headers: #{total_size} bytes)"
+
+  puts "Created initramfs: #{output_file} (#{File.size(output_file)} bytes, #{entries.size} programs)"
 end
 
 if ARGV[0] != nil
@@ -50,4 +161,4 @@ end
 
 FileUtils.mkdir_p(File.dirname(output_file))
 
-create_initramfs(app_dir, output_file)
\ No newline at end of file
+create_initramfs(app_dir, output_file)